@@ -0,0 +1,113 @@
+/*
+	ABDADA: a third way to spread the search over the workers.
+
+	As with Lazy SMP every worker runs a serial iterative deepening search of the root and
+	the workers share the transposition table, but they all search the same iterations. A
+	worker marks the nodes it is searching (TTMarkBusy); when a node's eldest move has been
+	searched, its brothers that another worker is already busy with are deferred to the end
+	of the move list, so the workers drift apart to different subtrees instead of searching
+	the same ones. This gets most of young brothers wait's sharing of work without split
+	points. Nodes with less than ABDADA_MIN_DEPTH plies left are searched by AlphaBeta since
+	the marks are not worth their cost there.
+*/
+#ifndef ABDADA_H
+#define ABDADA_H
+
+#include "search.h"
+#include "lazysmp.h"
+
+#define ABDADA_MIN_DEPTH 3
+
+Counter abdada_deferred;
+
+/*
+	searches the moves in order, deferring the busy brothers of the eldest, then the
+	deferred ones. the best move goes to *best_sq and its score is returned; with break_ties
+	(at the root) scores of ties are exact and they go to the highest square.
+*/
+int ABDADAMoves(ull P, ull O, int alpha, int beta, int depth, int *squares, int n, bool break_ties, int *best_sq);
+
+int ABDADA(ull P, ull O, int alpha, int beta, int depth, bool passed)
+{
+	if (depth < ABDADA_MIN_DEPTH) return AlphaBeta(P, O, alpha, beta, depth, passed);
+	if (search_abort.load(std::memory_order_relaxed)) return 0;
+
+	CounterAdd(&search_nodes, 1);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return PopCount(P) - PopCount(O);
+		return -ABDADA(O, P, -beta, -alpha, depth, true);
+	}
+
+	int score, hash_move;
+	if (TTCutoff(P, O, alpha, beta, depth, &score, &hash_move)) return score;
+	if (ETCutoff(P, O, moves, beta, depth, &score)) return score;
+	if (ProbCut(P, O, alpha, beta, depth, &score)) return score;
+
+	int squares[MAX_MOVES], best_sq;
+	int n = OrderMoves(P, O, moves, depth, hash_move, squares);
+
+	ull h = HashPosition(P, O);
+	bool marked = TTMarkBusy(h);
+	score = ABDADAMoves(P, O, alpha, beta, depth, squares, n, false, &best_sq);
+	if (marked) TTUnmarkBusy(h);
+
+	if (!search_abort.load(std::memory_order_relaxed)) TTStore(P, O, depth, alpha, beta, score, best_sq);
+	return score;
+}
+
+int ABDADAMoves(ull P, ull O, int alpha, int beta, int depth, int *squares, int n, bool break_ties, int *best_sq)
+{
+	int deferred[MAX_MOVES];
+	int ndeferred = 0;
+	int best = -SCORE_INF;
+
+	*best_sq = TT_NO_MOVE;
+	for (int pass = 0; pass < 2; pass++) {
+		int nmoves = pass == 0 ? n : ndeferred;
+		int *list = pass == 0 ? squares : deferred;
+		for (int i = 0; i < nmoves; i++) {
+			int sq = list[i];
+			ull flips = GetFlips(sq, P, O);
+			ull child_P = O & ~flips, child_O = P | flips | BB_SQUARE(sq);
+
+			if (pass == 0 && i > 0 && depth - 1 >= ABDADA_MIN_DEPTH && TTIsBusy(HashPosition(child_P, child_O))) {
+				CounterAdd(&abdada_deferred, 1);
+				deferred[ndeferred++] = sq;
+				continue;
+			}
+
+			/* at the root a window starting just below best keeps the scores of ties exact */
+			int a = break_ties ? best - 1 : (best > alpha ? best : alpha);
+			int score = -ABDADA(child_P, child_O, -beta, -a, depth - 1, false);
+			if (search_abort.load(std::memory_order_relaxed)) return best;
+
+			if (score > best || (break_ties && score == best && sq > *best_sq)) {
+				best = score;
+				*best_sq = sq;
+				if (best >= beta) return best;
+			}
+		}
+	}
+	return best;
+}
+
+/* the root search for SharedTableSearch, see SearchRoot */
+int ABDADARoot(ull P, ull O, int depth, int *best_sq)
+{
+	TTData d;
+	int squares[MAX_MOVES];
+	int n = OrderMoves(P, O, GetMoves(P, O), depth, TTProbe(P, O, &d) ? d.move : TT_NO_MOVE, squares);
+
+	int best = ABDADAMoves(P, O, -SCORE_INF, SCORE_INF, depth, squares, n, true, best_sq);
+	if (!search_abort.load(std::memory_order_relaxed)) TTStore(P, O, depth, -SCORE_INF, SCORE_INF, best, *best_sq);
+	return best;
+}
+
+int ABDADASearch(ull P, ull O, int depth, int *best_sq)
+{
+	return SharedTableSearch(P, O, depth, 1, ABDADARoot, best_sq);
+}
+
+#endif
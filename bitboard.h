@@ -0,0 +1,150 @@
+/*
+	bitboard helpers used by the search code.
+
+	The bit layout is the one used by BOARD_BIT_INDEX in othello.cpp: square (row,col)
+	is bit (8-row)*8 + (8-col), so row 1 col 1 is bit 63 and row 8 col 8 is bit 0.
+	Functions take the disks of the side to move (P) and of its opponent (O) instead of a
+	Board and a color so that negamax can swap them without caring about colors.
+*/
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+typedef unsigned long long ull;
+
+#define BB_COL8 0x0101010101010101ULL
+#define BB_COL1 0x8080808080808080ULL
+#define BB_SQUARE(sq) (1ULL << (sq))
+
+/* scores are disk differences, so they all lie strictly between -SCORE_INF and SCORE_INF */
+#define SCORE_INF 65
+
+/* the most legal moves a position can have, the size of the arrays of a node's moves */
+#define MAX_MOVES 33
+
+/* row and col of a square index, the inverse of BOARD_BIT_INDEX */
+#define SQUARE_ROW(sq) (8 - (sq) / 8)
+#define SQUARE_COL(sq) (8 - (sq) % 8)
+
+/*
+	shift amounts for the 8 directions, along with the mask of squares a shifted disk
+	may land on. a shift by +-1 (and the diagonals) wraps from one row into the next,
+	so the column the wrapped disks would land in is masked out.
+*/
+static const int bb_shift[8] = { 1, -1, 8, -8, 9, 7, -7, -9 };
+static const ull bb_mask[8] = {
+	~BB_COL8, ~BB_COL1, ~0ULL, ~0ULL, ~BB_COL8, ~BB_COL1, ~BB_COL8, ~BB_COL1
+};
+
+static inline ull BBShift(ull b, int dir)
+{
+	int s = bb_shift[dir];
+	return (s > 0 ? b << s : b >> -s) & bb_mask[dir];
+}
+
+static inline int PopCount(ull b)
+{
+	return __builtin_popcountll(b);
+}
+
+/* the set of empty squares where the side to move flips at least one disk */
+static inline ull GetMoves(ull P, ull O)
+{
+	ull moves = 0;
+	ull empty = ~(P | O);
+	for (int dir = 0; dir < 8; dir++) {
+		ull x = BBShift(P, dir) & O;
+		x |= BBShift(x, dir) & O;
+		x |= BBShift(x, dir) & O;
+		x |= BBShift(x, dir) & O;
+		x |= BBShift(x, dir) & O;
+		x |= BBShift(x, dir) & O;
+		moves |= BBShift(x, dir) & empty;
+	}
+	return moves;
+}
+
+/* the opponent disks flipped when the side to move plays on square sq */
+static inline ull GetFlips(int sq, ull P, ull O)
+{
+	ull flips = 0;
+	ull m = BB_SQUARE(sq);
+	for (int dir = 0; dir < 8; dir++) {
+		ull line = 0;
+		ull next = BBShift(m, dir);
+		while (next & O) {
+			line |= next;
+			next = BBShift(next, dir);
+		}
+		if (next & P) flips |= line;
+	}
+	return flips;
+}
+
+/* the board reflected top to bottom (row r to row 9-r) */
+static inline ull FlipVertical(ull b)
+{
+	return __builtin_bswap64(b);
+}
+
+/* the board reflected left to right (col c to col 9-c) */
+static inline ull FlipHorizontal(ull b)
+{
+	b = (b >> 1 & 0x5555555555555555ULL) | (b & 0x5555555555555555ULL) << 1;
+	b = (b >> 2 & 0x3333333333333333ULL) | (b & 0x3333333333333333ULL) << 2;
+	return (b >> 4 & 0x0f0f0f0f0f0f0f0fULL) | (b & 0x0f0f0f0f0f0f0f0fULL) << 4;
+}
+
+/* the board reflected about its main diagonal (row r col c to row c col r) */
+static inline ull FlipDiagonal(ull b)
+{
+	ull t = 0x0f0f0f0f00000000ULL & (b ^ b << 28);
+	b ^= t ^ t >> 28;
+	t = 0x3333000033330000ULL & (b ^ b << 14);
+	b ^= t ^ t >> 14;
+	t = 0x5500550055005500ULL & (b ^ b << 7);
+	return b ^ t ^ t >> 7;
+}
+
+/*
+	the board under symmetry s of the square, 0-7: bit 0 reflects it left to right, bit 1 top
+	to bottom and bit 2 about the main diagonal, in that order. symmetry 0 is the identity.
+*/
+static inline ull Symmetry(ull b, int s)
+{
+	if (s & 1) b = FlipHorizontal(b);
+	if (s & 2) b = FlipVertical(b);
+	if (s & 4) b = FlipDiagonal(b);
+	return b;
+}
+
+/* the board under the inverse of symmetry s, which undoes Symmetry(b, s) */
+static inline ull SymmetryInverse(ull b, int s)
+{
+	if (s & 4) b = FlipDiagonal(b);
+	if (s & 2) b = FlipVertical(b);
+	if (s & 1) b = FlipHorizontal(b);
+	return b;
+}
+
+/*
+	replaces the position by the smallest of its 8 symmetric images, comparing P first and
+	then O, so that all of them have the same canonical form. returns the symmetry used.
+*/
+static inline int CanonicalPosition(ull *P, ull *O)
+{
+	int best = 0;
+	ull best_P = *P, best_O = *O;
+	for (int s = 1; s < 8; s++) {
+		ull p = Symmetry(*P, s), o = Symmetry(*O, s);
+		if (p < best_P || (p == best_P && o < best_O)) {
+			best_P = p;
+			best_O = o;
+			best = s;
+		}
+	}
+	*P = best_P;
+	*O = best_O;
+	return best;
+}
+
+#endif
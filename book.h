@@ -0,0 +1,171 @@
+/*
+	opening book: positions near the start of the game with the best move and its score,
+	looked up before searching so that the opening moves are played at once.
+
+	The book is a binary file mapped read only into memory, so opening it costs nothing and
+	only the pages of the entries a lookup touches are ever read from disk. It holds a
+	header followed by the entries sorted by hash, in the byte order of the machine:
+
+		char magic[8] = "OTHBOOK1"; ull nentries;
+		BookEntry entries[nentries];
+
+	A position is stored in its canonical form (CanonicalPosition), keyed by HashPosition
+	of it, with the disks of the side to move first, so all 8 symmetric images of a position
+	share one entry. The move is a square of the canonical position, which the lookup maps
+	back through the inverse of the symmetry. A lookup is a binary search on the hash, the
+	entries with an equal hash are told apart by the position itself.
+*/
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "bitboard.h"
+#include "counter.h"
+#include "tt.h"
+
+#define BOOK_MAGIC "OTHBOOK1"
+
+/* move of an entry whose side to move has to pass */
+#define BOOK_NO_MOVE 255
+
+/* 32 bytes, two entries to a cache line */
+typedef struct {
+	ull hash, P, O;
+	unsigned char move, depth;
+	signed char score;
+	unsigned char pad[5];
+} BookEntry;
+
+typedef struct { char magic[8]; ull nentries; } BookHeader;
+
+typedef struct { const BookEntry *entries; ull n; void *map; size_t size; } Book;
+
+Book book = { NULL, 0, NULL, 0 };
+
+Counter book_probes, book_hits;
+
+void BookClose()
+{
+	if (book.map) munmap(book.map, book.size);
+	book.entries = NULL;
+	book.n = 0;
+	book.map = NULL;
+	book.size = 0;
+}
+
+/* maps the book file, checking its header against its size */
+bool BookOpen(const char *path)
+{
+	BookClose();
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("cannot open book %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(BookHeader)) {
+		printf("book %s is too short\n", path);
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		printf("cannot map book %s\n", path);
+		return false;
+	}
+
+	const BookHeader *header = (const BookHeader *) map;
+	if (memcmp(header->magic, BOOK_MAGIC, 8) != 0
+		|| sizeof(BookHeader) + header->nentries * sizeof(BookEntry) != (ull) st.st_size) {
+		printf("%s is not a book\n", path);
+		munmap(map, st.st_size);
+		return false;
+	}
+	/* lookups jump around the file, reading ahead would page in entries never used */
+	madvise(map, st.st_size, MADV_RANDOM);
+
+	book.map = map;
+	book.size = st.st_size;
+	book.entries = (const BookEntry *) (header + 1);
+	book.n = header->nentries;
+	return true;
+}
+
+static inline bool BookEntryLess(const BookEntry &a, const BookEntry &b)
+{
+	if (a.hash != b.hash) return a.hash < b.hash;
+	return a.P < b.P || (a.P == b.P && a.O < b.O);
+}
+
+/*
+	writes the entries as a book, sorting them by hash. the book is written next to path and
+	renamed over it at the end, so a reader never maps a book that is half written.
+*/
+bool BookWrite(const char *path, std::vector<BookEntry> &entries)
+{
+	std::sort(entries.begin(), entries.end(), BookEntryLess);
+	std::string tmp = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (!f) {
+		printf("cannot write book %s\n", tmp.c_str());
+		return false;
+	}
+	BookHeader header;
+	memcpy(header.magic, BOOK_MAGIC, 8);
+	header.nentries = entries.size();
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(entries.data(), sizeof(BookEntry), entries.size(), f) == entries.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), path) != 0) {
+		printf("cannot write book %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+/* the entry of the canonical position (P, O) with hash h, NULL when it is not in the book */
+const BookEntry *BookFind(ull P, ull O, ull h)
+{
+	ull lo = 0, hi = book.n;
+	while (lo < hi) {
+		ull mid = lo + (hi - lo) / 2;
+		if (book.entries[mid].hash < h) lo = mid + 1;
+		else hi = mid;
+	}
+	for (; lo < book.n && book.entries[lo].hash == h; lo++) {
+		if (book.entries[lo].P == P && book.entries[lo].O == O) return &book.entries[lo];
+	}
+	return NULL;
+}
+
+/*
+	looks the position up in the book. returns true along with the book move, a square of
+	(P, O), and its score when it is there with a move to play.
+*/
+bool BookProbe(ull P, ull O, int *best_sq, int *score)
+{
+	if (!book.entries) return false;
+	CounterAdd(&book_probes, 1);
+	ull canonical_P = P, canonical_O = O;
+	int s = CanonicalPosition(&canonical_P, &canonical_O);
+	const BookEntry *e = BookFind(canonical_P, canonical_O, HashPosition(canonical_P, canonical_O));
+	if (!e || e->move == BOOK_NO_MOVE) return false;
+
+	int sq = __builtin_ctzll(SymmetryInverse(BB_SQUARE(e->move), s));
+	if (!(GetMoves(P, O) & BB_SQUARE(sq))) return false;
+	CounterAdd(&book_hits, 1);
+	*best_sq = sq;
+	*score = e->score;
+	return true;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*
+	offline opening book builder (othello book-build).
+
+	The opening tree is expanded breadth first from the start position to a number of
+	plies, one level per ply, every position in its canonical form so that transpositions and
+	symmetric lines are expanded once. The positions of the last level, the leaves, are
+	searched to a fixed depth and their values negamaxed back up the tree; every position of
+	the tree then goes to the book with its best move and score.
+
+	The leaves are searched many at once: the workers share out whole leaves of a batch
+	(cilk_for), each searched serially by SearchRoot with iterative deepening, all of them
+	through the shared transposition table. There are far more leaves than workers, so game
+	level parallelism keeps every worker busy without the overhead of splitting the trees.
+
+	A build is resumable. After each batch the results of its leaves are appended to a log
+	next to the book (path.leaves), one BookEntry per leaf, and flushed. A build first reads
+	back the log and only searches the leaves missing from it, so a build killed by a time
+	limit goes on where it stopped when run again with the same arguments; a limit in
+	seconds stops it cleanly between batches instead. A logged leaf searched to another
+	depth than the build's is searched again, so a book never mixes depths. The book is
+	written once every leaf is done, and the log is then removed.
+*/
+#ifndef BOOKBUILD_H
+#define BOOKBUILD_H
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "bitboard.h"
+#include "book.h"
+#include "search.h"
+#include "tt.h"
+
+/* leaves per worker in a batch, the results are logged once per batch */
+#define BOOK_BATCH_LEAVES 8
+
+/* depth of the exact score of a finished game */
+#define BOOK_EXACT_DEPTH 60
+
+static inline bool BookPositionLess(const BookEntry &a, const BookEntry &b)
+{
+	return a.P < b.P || (a.P == b.P && a.O < b.O);
+}
+
+/* the entry of the canonical position (P, O) in a level sorted by position, NULL if none */
+BookEntry *BookLevelFind(std::vector<BookEntry> &level, ull P, ull O)
+{
+	BookEntry key;
+	key.P = P;
+	key.O = O;
+	std::vector<BookEntry>::iterator it = std::lower_bound(level.begin(), level.end(), key, BookPositionLess);
+	return it != level.end() && it->P == P && it->O == O ? &*it : NULL;
+}
+
+/* the canonical children of the canonical position, a pass being a child of its own */
+int BookChildren(ull P, ull O, ull *child_P, ull *child_O, int *squares)
+{
+	ull moves = GetMoves(P, O);
+	int n = 0;
+	if (!moves) {
+		if (!GetMoves(O, P)) return 0;
+		child_P[0] = O;
+		child_O[0] = P;
+		squares[n++] = BOOK_NO_MOVE;
+	}
+	for (; moves; moves &= moves - 1) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, P, O);
+		child_P[n] = O & ~flips;
+		child_O[n] = P | flips | BB_SQUARE(sq);
+		squares[n++] = sq;
+	}
+	for (int i = 0; i < n; i++) CanonicalPosition(&child_P[i], &child_O[i]);
+	return n;
+}
+
+/* searches a leaf to the depth, deepening from 1 to order the moves from the table */
+void BookSearchLeaf(BookEntry *e, int depth)
+{
+	ull P = e->P, O = e->O;
+	bool passed = !GetMoves(P, O);
+	if (passed && !GetMoves(O, P)) {
+		e->score = PopCount(P) - PopCount(O);
+		e->move = BOOK_NO_MOVE;
+		e->depth = BOOK_EXACT_DEPTH;
+		return;
+	}
+	int score = 0, best_sq = TT_NO_MOVE;
+	for (int d = 1; d <= depth; d++) score = passed ? -SearchRoot(O, P, d, &best_sq) : SearchRoot(P, O, d, &best_sq);
+	e->score = score;
+	e->move = passed ? BOOK_NO_MOVE : best_sq;
+	e->depth = depth;
+}
+
+/*
+	builds the book of the positions up to plies plies from (P, O), the leaves searched to
+	depth. returns 0 when the book is written, 2 when the time limit (seconds, 0 for none)
+	stopped the build before, and 1 on errors.
+*/
+int BookBuild(ull P, ull O, int plies, int depth, const char *path, double seconds)
+{
+	timer_start();
+	std::vector<std::vector<BookEntry> > levels(plies + 1);
+	BookEntry root;
+	memset(&root, 0, sizeof(root));
+	CanonicalPosition(&P, &O);
+	root.P = P;
+	root.O = O;
+	levels[0].push_back(root);
+
+	for (int ply = 0; ply < plies; ply++) {
+		std::vector<BookEntry> &next = levels[ply + 1];
+		for (size_t i = 0; i < levels[ply].size(); i++) {
+			ull child_P[MAX_MOVES], child_O[MAX_MOVES];
+			int squares[MAX_MOVES];
+			int n = BookChildren(levels[ply][i].P, levels[ply][i].O, child_P, child_O, squares);
+			for (int j = 0; j < n; j++) {
+				BookEntry e = root;
+				e.P = child_P[j];
+				e.O = child_O[j];
+				next.push_back(e);
+			}
+		}
+		std::sort(next.begin(), next.end(), BookPositionLess);
+		next.erase(std::unique(next.begin(), next.end(),
+			[](const BookEntry &a, const BookEntry &b) { return a.P == b.P && a.O == b.O; }), next.end());
+		printf("book-build ply=%d positions=%zu\n", ply + 1, next.size());
+	}
+
+	/*
+		the leaves already in the log to this depth are done, or exactly; a record cut short
+		by a kill is dropped
+	*/
+	std::vector<BookEntry> &leaves = levels[plies];
+	std::string log_path = std::string(path) + ".leaves";
+	size_t logged = 0;
+	FILE *log = fopen(log_path.c_str(), "rb");
+	if (log) {
+		BookEntry e;
+		while (fread(&e, sizeof(e), 1, log) == 1) {
+			BookEntry *leaf = BookLevelFind(leaves, e.P, e.O);
+			if (leaf && !leaf->depth && (e.depth == depth || e.depth == BOOK_EXACT_DEPTH)) {
+				*leaf = e;
+				logged++;
+			}
+		}
+		long good = ftell(log) / sizeof(BookEntry) * sizeof(BookEntry);
+		fclose(log);
+		if (truncate(log_path.c_str(), good) != 0) {
+			printf("cannot truncate %s\n", log_path.c_str());
+			return 1;
+		}
+	}
+	log = fopen(log_path.c_str(), "ab");
+	if (!log) {
+		printf("cannot open %s\n", log_path.c_str());
+		return 1;
+	}
+
+	std::vector<size_t> todo;
+	for (size_t i = 0; i < leaves.size(); i++) {
+		if (!leaves[i].depth) todo.push_back(i);
+	}
+	printf("book-build leaves=%zu logged=%zu to search=%zu depth=%d\n", leaves.size(), logged, todo.size(), depth);
+
+	TTNewSearch();
+	size_t batch = (size_t) BOOK_BATCH_LEAVES * __cilkrts_get_nworkers();
+	for (size_t start = 0; start < todo.size(); start += batch) {
+		if (seconds > 0 && timer_elapsed() >= seconds) {
+			fclose(log);
+			printf("book-build stopped by the time limit after %.0f s with %zu leaves left, run it again to resume\n",
+				timer_elapsed(), todo.size() - start);
+			return 2;
+		}
+		size_t end = std::min(start + batch, todo.size());
+		cilk_for(size_t i = start; i < end; i++) BookSearchLeaf(&leaves[todo[i]], depth);
+		for (size_t i = start; i < end; i++) {
+			if (fwrite(&leaves[todo[i]], sizeof(BookEntry), 1, log) != 1) {
+				printf("cannot write %s\n", log_path.c_str());
+				fclose(log);
+				return 1;
+			}
+		}
+		fflush(log);
+		printf("book-build searched=%zu/%zu time=%.1f\n", end, todo.size(), timer_elapsed());
+		fflush(stdout);
+	}
+	fclose(log);
+
+	/* negamax up the levels, ties going to the highest square as in the search */
+	for (int ply = plies - 1; ply >= 0; ply--) {
+		for (size_t i = 0; i < levels[ply].size(); i++) {
+			BookEntry *e = &levels[ply][i];
+			ull child_P[MAX_MOVES], child_O[MAX_MOVES];
+			int squares[MAX_MOVES];
+			int n = BookChildren(e->P, e->O, child_P, child_O, squares);
+			if (n == 0) {
+				e->score = PopCount(e->P) - PopCount(e->O);
+				e->move = BOOK_NO_MOVE;
+				e->depth = BOOK_EXACT_DEPTH;
+				continue;
+			}
+			int best = -SCORE_INF, best_sq = -1, best_depth = 0;
+			for (int j = 0; j < n; j++) {
+				const BookEntry *child = BookLevelFind(levels[ply + 1], child_P[j], child_O[j]);
+				int score = -child->score;
+				if (score > best || (score == best && squares[j] > best_sq)) {
+					best = score;
+					best_sq = squares[j];
+					best_depth = child->depth;
+				}
+			}
+			e->score = best;
+			e->move = best_sq;
+			e->depth = std::min(best_depth + 1, 255);
+		}
+	}
+
+	/* a position reached at two plies, through a pass, keeps its deepest entry */
+	std::vector<BookEntry> entries;
+	for (int ply = 0; ply <= plies; ply++) {
+		for (size_t i = 0; i < levels[ply].size(); i++) {
+			BookEntry e = levels[ply][i];
+			e.hash = HashPosition(e.P, e.O);
+			entries.push_back(e);
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [](const BookEntry &a, const BookEntry &b) {
+		return BookEntryLess(a, b) || (!BookEntryLess(b, a) && a.depth > b.depth);
+	});
+	entries.erase(std::unique(entries.begin(), entries.end(),
+		[](const BookEntry &a, const BookEntry &b) { return a.P == b.P && a.O == b.O; }), entries.end());
+
+	if (!BookWrite(path, entries)) return 1;
+	if (unlink(log_path.c_str()) != 0) printf("cannot remove %s\n", log_path.c_str());
+	printf("book-build wrote %zu positions to %s in %.1f s, start score %d\n", entries.size(), path,
+		timer_elapsed(), levels[0][0].score);
+	return 0;
+}
+
+#endif
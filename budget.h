@@ -0,0 +1,86 @@
+/*
+	node budgeted search: each move is searched to a number of nodes instead of a depth.
+
+	The deepening stops before an iteration that would take the nodes searched past the
+	budget, estimating its size from the growth of the previous iterations. To pick the same
+	move on every run the search must not depend on the timing of the workers, so
+	- the tree is only split at the root: the eldest move is searched alone and its brothers
+	  in parallel with the window it gave, each below the root with the serial AlphaBeta
+	- the table is not written during an iteration; the stores are deferred (tt_defer) and
+	  flushed in a fixed order between iterations, so every probe sees the same table
+	- the search of each root move, and the store of the root, is one task of deferred
+	  stores (TTDeferTask). a task keeps at most TT_DEFER_MAX of them and drops the
+	  shallowest beyond, so a large budget holds at most that many per root move in memory
+	  and the table after the flush is still the same on every run
+	The node count is the per worker search_nodes counter, summed between iterations only.
+*/
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <cilk/cilk.h>
+#include "search.h"
+
+/* nodes per computer move, 0 searches to the player's depth instead */
+ull node_budget = 0;
+
+/* one iteration of the deterministic root, see SearchRoot */
+int BudgetRoot(ull P, ull O, int depth, int *best_sq)
+{
+	TTData d;
+	int squares[MAX_MOVES], scores[MAX_MOVES];
+	int n = OrderMoves(P, O, GetMoves(P, O), depth, TTProbe(P, O, &d) ? d.move : TT_NO_MOVE, squares);
+
+	ull flips = GetFlips(squares[0], P, O);
+	TTDeferTask();
+	int best = -AlphaBeta(O & ~flips, P | flips | BB_SQUARE(squares[0]), -SCORE_INF, SCORE_INF, depth - 1, false);
+	*best_sq = squares[0];
+
+	/* a window starting just below best keeps the scores of equally good moves exact */
+	cilk_for(int i = 1; i < n; i++) {
+		ull f = GetFlips(squares[i], P, O);
+		TTDeferTask();
+		scores[i] = -AlphaBeta(O & ~f, P | f | BB_SQUARE(squares[i]), -SCORE_INF, -(best - 1), depth - 1, false);
+	}
+	for (int i = 1; i < n; i++) {
+		if (scores[i] > best || (scores[i] == best && squares[i] > *best_sq)) {
+			best = scores[i];
+			*best_sq = squares[i];
+		}
+	}
+	TTDeferTask();
+	TTStore(P, O, depth, -SCORE_INF, SCORE_INF, best, *best_sq);
+	return best;
+}
+
+/*
+	deepens up to max_depth within the budget, at least one ply. the best square goes to
+	*best_sq (-1 without a legal move) and the depth searched to *depth.
+*/
+int BudgetSearch(ull P, ull O, int max_depth, ull budget, int *best_sq, int *depth)
+{
+	*best_sq = -1;
+	*depth = 0;
+	if (!GetMoves(P, O)) return 0;
+
+	ull start = CounterTotal(&search_nodes);
+	ull previous = 0, last = 0;
+	int score = 0;
+
+	tt_defer = true;
+	for (int d = 1; d <= max_depth; d++) {
+		/* the next iteration grows by the same factor as the last one did */
+		ull used = CounterTotal(&search_nodes) - start;
+		if (d > 1 && used + (previous ? last * last / previous : last) > budget) break;
+
+		score = BudgetRoot(P, O, d, best_sq);
+		TTFlush();
+		*depth = d;
+
+		previous = last;
+		last = CounterTotal(&search_nodes) - start - used;
+	}
+	tt_defer = false;
+	return score;
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+	event counters that are cheap to bump from inside the parallel search.
+	every cilk worker increments its own cache line, so there is no atomic and no false
+	sharing on the hot path; the slots are only summed when a total is reported.
+*/
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <cilk/cilk_api.h>
+
+typedef unsigned long long ull;
+
+#define COUNTER_SLOTS 256
+
+typedef struct { ull value; char pad[64 - sizeof(ull)]; } CounterSlot;
+
+typedef struct { CounterSlot slot[COUNTER_SLOTS]; } Counter;
+
+static inline void CounterAdd(Counter *c, ull n)
+{
+	c->slot[__cilkrts_get_worker_number() & (COUNTER_SLOTS - 1)].value += n;
+}
+
+ull CounterTotal(const Counter *c)
+{
+	ull total = 0;
+	for (int i = 0; i < COUNTER_SLOTS; i++) total += c->slot[i].value;
+	return total;
+}
+
+void CounterReset(Counter *c)
+{
+	for (int i = 0; i < COUNTER_SLOTS; i++) c->slot[i].value = 0;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+	proof-number solver (df-pn) for positions too deep for the alpha-beta endgame solver.
+
+	A proof does not compute the score, it answers whether the side to move gets at least
+	a target disk difference t: the side to move needs one move after which the opponent
+	does not get at least 1-t, so every node is an OR node in negamax form. A node holds
+	a proof number pn, the least number of leaves that still have to be proven for the
+	target to be reached, and a disproof number dn, for it to be missed:
+		pn = min over the children of their dn, dn = sum over the children of their pn
+	The depth-first variant (Nagai's df-pn) always descends into the child with the
+	smallest dn, with thresholds that send it back up as soon as another child would be
+	better, and keeps the numbers of the nodes it leaves in a table instead of a tree.
+	- the table has a fixed size, so the memory is bounded: a bucket keeps the entries
+	  that took the most work to compute, a lost entry is recomputed when needed
+	- positions with at most DFPN_LEAF_EMPTIES empties are decided by a null window
+	  SolveEndgame, which is much faster there than proof numbers
+	- the root children are proven in parallel, one serial df-pn per child on a table of
+	  its worker's own; once a child is disproven the root is proven and the others stop
+	- every DFPN_REPORT_NODES nodes a child prints its proof and disproof numbers
+	Win, draw or loss takes two proofs, targets 1 and 0.
+*/
+#ifndef DFPN_H
+#define DFPN_H
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include "bitboard.h"
+#include "counter.h"
+#include "endgame.h"
+#include "tt.h"
+
+/* a proof or disproof number that cannot be reached: the node is decided */
+#define DFPN_INF 0xffffffffU
+
+/* at most this many empties a node is decided by the alpha-beta solver */
+#define DFPN_LEAF_EMPTIES 12
+
+#define DFPN_BUCKET 4
+
+/* a child search prints its progress every this many nodes */
+#define DFPN_REPORT_NODES (1ULL << 22)
+
+/* 32 bytes, the target is part of the key since it alternates between t and 1-t */
+typedef struct { ull P, O; unsigned int pn, dn, work; int target; } DfpnEntry;
+
+typedef struct { DfpnEntry *entries; ull mask; } DfpnTable;
+
+/* one table per worker */
+DfpnTable dfpn_tables[COUNTER_SLOTS];
+int dfpn_ntables = 0;
+
+/* stops the child searches once the root is decided */
+std::atomic<bool> dfpn_abort(false);
+
+Counter dfpn_nodes;
+
+/* the search of one root child */
+typedef struct { DfpnTable *table; ull P, O; int target, sq; ull nodes; struct timespec start; } DfpnTask;
+
+/* splits megabytes over one table per worker, 0 frees the tables */
+bool DfpnInit(ull megabytes)
+{
+	for (int i = 0; i < dfpn_ntables; i++) free(dfpn_tables[i].entries);
+	dfpn_ntables = 0;
+	if (megabytes == 0) return true;
+
+	int nworkers = __cilkrts_get_nworkers();
+	ull n = DFPN_BUCKET;
+	while (2 * n * sizeof(DfpnEntry) * nworkers <= megabytes << 20) n *= 2;
+	for (int i = 0; i < nworkers; i++) {
+		DfpnEntry *entries = (DfpnEntry *) calloc(n, sizeof(DfpnEntry));
+		if (!entries) {
+			printf("cannot allocate %llu MB of df-pn tables\n", megabytes);
+			return false;
+		}
+		dfpn_tables[i].entries = entries;
+		dfpn_tables[i].mask = n - 1;
+		dfpn_ntables++;
+	}
+	return true;
+}
+
+static inline DfpnEntry *DfpnBucket(DfpnTable *table, ull P, ull O, int target)
+{
+	ull h = HashPosition(P, O) ^ (ull) (target + 128) * 0x9e3779b97f4a7c15ULL;
+	return &table->entries[h & table->mask & ~(ull) (DFPN_BUCKET - 1)];
+}
+
+/* the numbers of the node, 1 and 1 when it is not in the table */
+void DfpnLookup(DfpnTable *table, ull P, ull O, int target, unsigned int *pn, unsigned int *dn)
+{
+	DfpnEntry *bucket = DfpnBucket(table, P, O, target);
+	for (int i = 0; i < DFPN_BUCKET; i++) {
+		if (bucket[i].P == P && bucket[i].O == O && bucket[i].target == target && bucket[i].work) {
+			*pn = bucket[i].pn;
+			*dn = bucket[i].dn;
+			return;
+		}
+	}
+	*pn = 1;
+	*dn = 1;
+}
+
+/* stores over the same node or else over the entry that took the least work */
+void DfpnStore(DfpnTable *table, ull P, ull O, int target, unsigned int pn, unsigned int dn, ull work)
+{
+	DfpnEntry *bucket = DfpnBucket(table, P, O, target);
+	DfpnEntry *replace = &bucket[0];
+	for (int i = 0; i < DFPN_BUCKET; i++) {
+		if (bucket[i].P == P && bucket[i].O == O && bucket[i].target == target) {
+			replace = &bucket[i];
+			break;
+		}
+		if (bucket[i].work < replace->work) replace = &bucket[i];
+	}
+	replace->P = P;
+	replace->O = O;
+	replace->target = target;
+	replace->pn = pn;
+	replace->dn = dn;
+	/* decided nodes are worth keeping whatever they cost */
+	replace->work = pn == 0 || dn == 0 ? DFPN_INF : (unsigned int) (work < DFPN_INF - 1 ? work + 1 : DFPN_INF - 1);
+}
+
+/* the children of the node, the position after a pass being its only child */
+int DfpnChildren(ull P, ull O, ull *child_P, ull *child_O, int *squares)
+{
+	ull moves = GetMoves(P, O);
+	int n = 0;
+	if (!moves) {
+		child_P[0] = O;
+		child_O[0] = P;
+		squares[0] = -1;
+		return GetMoves(O, P) ? 1 : 0;
+	}
+	for (; moves; moves &= moves - 1) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, P, O);
+		child_P[n] = O & ~flips;
+		child_O[n] = P | flips | BB_SQUARE(sq);
+		squares[n++] = sq;
+	}
+	return n;
+}
+
+void DfpnReport(DfpnTask *task)
+{
+	unsigned int pn, dn;
+	DfpnLookup(task->table, task->P, task->O, task->target, &pn, &dn);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = (now.tv_sec - task->start.tv_sec) + (now.tv_nsec - task->start.tv_nsec) / 1e9;
+	printf("dfpn move=%d,%d pn=%u dn=%u nodes=%llu time=%.1f\n", task->sq < 0 ? 0 : SQUARE_ROW(task->sq),
+		task->sq < 0 ? 0 : SQUARE_COL(task->sq), pn, dn, task->nodes, elapsed);
+	fflush(stdout);
+}
+
+/* expands the node until its pn reaches thpn or its dn reaches thdn, see the top */
+void DfpnMID(DfpnTask *task, ull P, ull O, int target, unsigned int thpn, unsigned int thdn)
+{
+	if (dfpn_abort.load(std::memory_order_relaxed)) return;
+	CounterAdd(&dfpn_nodes, 1);
+	if (++task->nodes % DFPN_REPORT_NODES == 0) DfpnReport(task);
+
+	ull child_P[MAX_MOVES], child_O[MAX_MOVES];
+	int squares[MAX_MOVES];
+	int n = DfpnChildren(P, O, child_P, child_O, squares);
+	if (n == 0 || 64 - PopCount(P | O) <= DFPN_LEAF_EMPTIES) {
+		bool reached = n == 0 ? PopCount(P) - PopCount(O) >= target : SolveEndgame(P, O, target - 1, target, false) >= target;
+		DfpnStore(task->table, P, O, target, reached ? 0 : DFPN_INF, reached ? DFPN_INF : 0, 1);
+		return;
+	}
+
+	ull start = task->nodes;
+	for (;;) {
+		unsigned int pn = DFPN_INF, dn = 0, dn2 = DFPN_INF, best_pn = 0;
+		int best = 0;
+		for (int i = 0; i < n; i++) {
+			unsigned int child_pn, child_dn;
+			DfpnLookup(task->table, child_P[i], child_O[i], 1 - target, &child_pn, &child_dn);
+			if (child_dn < pn) {
+				dn2 = pn;
+				pn = child_dn;
+				best = i;
+				best_pn = child_pn;
+			} else if (child_dn < dn2) {
+				dn2 = child_dn;
+			}
+			/* finite sums stay below DFPN_INF, which only a disproven child reaches */
+			if (child_pn == DFPN_INF || dn == DFPN_INF) dn = DFPN_INF;
+			else dn = dn + (ull) child_pn < DFPN_INF - 1 ? dn + child_pn : DFPN_INF - 1;
+		}
+		if (pn >= thpn || dn >= thdn || dfpn_abort.load(std::memory_order_relaxed)) {
+			DfpnStore(task->table, P, O, target, pn, dn, task->nodes - start);
+			return;
+		}
+		ull child_thpn = (ull) thdn - dn + best_pn;
+		DfpnMID(task, child_P[best], child_O[best], 1 - target,
+			child_thpn < DFPN_INF ? (unsigned int) child_thpn : DFPN_INF, thpn < dn2 + 1ULL ? thpn : dn2 + 1);
+	}
+}
+
+/*
+	whether the side to move of the task gets its target: 1 when it is proven, 0 when it
+	is disproven and -1 when the search was aborted before either
+*/
+int DfpnProve(DfpnTask *task)
+{
+	clock_gettime(CLOCK_MONOTONIC, &task->start);
+	task->nodes = 0;
+	DfpnMID(task, task->P, task->O, task->target, DFPN_INF, DFPN_INF);
+	unsigned int pn, dn;
+	DfpnLookup(task->table, task->P, task->O, task->target, &pn, &dn);
+	return pn == 0 ? 1 : dn == 0 ? 0 : -1;
+}
+
+/*
+	whether the side to move gets at least target, proving the root children in parallel.
+	when it does the move that proves it goes to *best_sq (-1 for a pass or a finished game).
+*/
+bool DfpnRoot(ull P, ull O, int target, int *best_sq)
+{
+	ull child_P[MAX_MOVES], child_O[MAX_MOVES];
+	int squares[MAX_MOVES];
+	int n = DfpnChildren(P, O, child_P, child_O, squares);
+	*best_sq = -1;
+	if (n == 0) return PopCount(P) - PopCount(O) >= target;
+
+	/* a child disproven, not getting 1-target, proves the root; the first one is the move */
+	int results[MAX_MOVES];
+	dfpn_abort = false;
+	cilk_for(int i = 0; i < n; i++) {
+		DfpnTask task;
+		task.table = &dfpn_tables[__cilkrts_get_worker_number() % dfpn_ntables];
+		task.P = child_P[i];
+		task.O = child_O[i];
+		task.target = 1 - target;
+		task.sq = squares[i];
+		results[i] = DfpnProve(&task);
+		bool expected = false;
+		if (results[i] == 0 && dfpn_abort.compare_exchange_strong(expected, true)) *best_sq = squares[i];
+	}
+	bool proven = dfpn_abort.load();
+	dfpn_abort = false;
+	return proven;
+}
+
+#endif
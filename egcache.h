@@ -0,0 +1,189 @@
+/*
+	persistent endgame cache: the exact scores and best moves the endgame solver finds,
+	kept in a file from one run to the next so that solving a position again is a lookup.
+
+	The file is a header followed by a hash table of fixed size, mapped shared into memory:
+	what the workers store goes to the page cache and from there to the file, without any
+	write call, and a run that opens the file sees every result of the runs before it. It
+	is append only in the sense that a slot is written once and never changed, so a file
+	is never left with half of an old entry and half of a new one. Positions are stored in
+	their canonical form (CanonicalPosition) with the move as a square of it, so the 8
+	symmetric images of a position share their entry.
+
+	Slots are claimed without locks. A store probes EGC_PROBES slots from the hash of the
+	position and takes the first free one by swapping its check word from 0 to
+	EGC_CLAIMED, then writes the entry and sets the check word last, to a hash of the whole
+	entry. A lookup only believes an entry whose check word matches, so it never reads a
+	slot still being written, nor one a killed run left claimed. A store that finds no free
+	slot is dropped; the file is created large (and sparse) enough for that to be rare.
+
+	Only exact results are kept, those the solver found strictly inside its window, for
+	positions with from EGC_MIN_EMPTIES to egcache_empties empty squares: smaller ones are
+	solved faster than a page is read in.
+*/
+#ifndef EGCACHE_H
+#define EGCACHE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include "bitboard.h"
+#include "counter.h"
+#include "tt.h"
+
+#define EGC_MAGIC "OTHEGC01"
+
+/* size of a new cache file */
+#define EGC_FILE_MB 1024
+
+/* slots probed from the hash of a position */
+#define EGC_PROBES 8
+
+/* positions with fewer empties are not cached */
+#define EGC_MIN_EMPTIES 10
+
+/* check word of a slot being written */
+#define EGC_CLAIMED 1ULL
+
+typedef struct { std::atomic<ull> P, O, data, check; } EGCEntry;
+
+typedef struct { char magic[8]; ull nslots; } EGCHeader;
+
+typedef struct { EGCEntry *entries; ull mask; void *map; size_t size; } EndgameCache;
+
+EndgameCache egcache = { NULL, 0, NULL, 0 };
+
+/* positions with at most this many empties are cached */
+int egcache_empties = 22;
+
+Counter egcache_probes, egcache_hits, egcache_stores;
+
+/* never 0 nor EGC_CLAIMED, so a slot that is free or claimed never passes the check */
+static inline ull EGCCheck(ull h, ull data)
+{
+	return (h ^ data * 0x9e3779b97f4a7c15ULL) | 2;
+}
+
+void EGCacheClose()
+{
+	if (egcache.map) munmap(egcache.map, egcache.size);
+	egcache.entries = NULL;
+	egcache.mask = 0;
+	egcache.map = NULL;
+	egcache.size = 0;
+}
+
+/* maps the cache file, creating an empty one of EGC_FILE_MB when there is none */
+bool EGCacheOpen(const char *path)
+{
+	EGCacheClose();
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		printf("cannot open endgame cache %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return false;
+	}
+	bool created = st.st_size == 0;
+	ull nslots = ((ull) EGC_FILE_MB << 20) / sizeof(EGCEntry);
+	size_t size = created ? sizeof(EGCHeader) + nslots * sizeof(EGCEntry) : st.st_size;
+	/* the file stays sparse, only the pages of the slots written take up disk */
+	if (created && ftruncate(fd, size) != 0) {
+		printf("cannot create endgame cache %s\n", path);
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		printf("cannot map endgame cache %s\n", path);
+		return false;
+	}
+
+	EGCHeader *header = (EGCHeader *) map;
+	if (created) {
+		memcpy(header->magic, EGC_MAGIC, 8);
+		header->nslots = nslots;
+	}
+	if (memcmp(header->magic, EGC_MAGIC, 8) != 0 || (header->nslots & (header->nslots - 1)) != 0
+		|| sizeof(EGCHeader) + header->nslots * sizeof(EGCEntry) != size) {
+		printf("%s is not an endgame cache\n", path);
+		munmap(map, size);
+		return false;
+	}
+	madvise(map, size, MADV_RANDOM);
+
+	egcache.map = map;
+	egcache.size = size;
+	egcache.entries = (EGCEntry *) (header + 1);
+	egcache.mask = header->nslots - 1;
+	return true;
+}
+
+static inline bool EGCacheCovers(ull P, ull O)
+{
+	int empties = 64 - PopCount(P | O);
+	return egcache.entries && empties >= EGC_MIN_EMPTIES && empties <= egcache_empties;
+}
+
+/*
+	looks up the exact score of the position. returns true along with it and the best
+	square of (P, O) when the position is in the cache.
+*/
+bool EGCacheProbe(ull P, ull O, int *score, int *best_sq)
+{
+	if (!EGCacheCovers(P, O)) return false;
+	CounterAdd(&egcache_probes, 1);
+	int s = CanonicalPosition(&P, &O);
+	ull h = HashPosition(P, O);
+	for (int i = 0; i < EGC_PROBES; i++) {
+		EGCEntry *e = &egcache.entries[(h + i) & egcache.mask];
+		ull check = e->check.load(std::memory_order_acquire);
+		if (check == 0) return false;
+		if (e->P.load(std::memory_order_relaxed) != P || e->O.load(std::memory_order_relaxed) != O) continue;
+		ull data = e->data.load(std::memory_order_relaxed);
+		if (check != EGCCheck(h, data)) continue;
+		CounterAdd(&egcache_hits, 1);
+		*score = (int) (data & 0xff) - 128;
+		*best_sq = __builtin_ctzll(SymmetryInverse(BB_SQUARE(data >> 8 & 0x3f), s));
+		return true;
+	}
+	return false;
+}
+
+/* stores the exact score of the position and its best square, a move of (P, O) */
+void EGCacheStore(ull P, ull O, int score, int best_sq)
+{
+	if (!EGCacheCovers(P, O)) return;
+	int s = CanonicalPosition(&P, &O);
+	ull h = HashPosition(P, O);
+	ull data = (ull) (score + 128) | (ull) __builtin_ctzll(Symmetry(BB_SQUARE(best_sq), s)) << 8;
+	for (int i = 0; i < EGC_PROBES; i++) {
+		EGCEntry *e = &egcache.entries[(h + i) & egcache.mask];
+		ull check = e->check.load(std::memory_order_acquire);
+		/* another worker may have solved the same position, or be writing it */
+		if (check != 0) {
+			if (e->P.load(std::memory_order_relaxed) == P && e->O.load(std::memory_order_relaxed) == O) return;
+			continue;
+		}
+		if (!e->check.compare_exchange_strong(check, EGC_CLAIMED, std::memory_order_acquire)) {
+			i--;
+			continue;
+		}
+		e->P.store(P, std::memory_order_relaxed);
+		e->O.store(O, std::memory_order_relaxed);
+		e->data.store(data, std::memory_order_relaxed);
+		e->check.store(EGCCheck(h, data), std::memory_order_release);
+		CounterAdd(&egcache_stores, 1);
+		return;
+	}
+}
+
+#endif
@@ -0,0 +1,230 @@
+/*
+	exact endgame solver.
+
+	Once few enough squares are empty the game can be searched to the end. The score is the
+	final disk difference from the side to move's point of view, the same quantity
+	findDifference computes at the search horizon.
+	- near the root the solver splits in young brothers wait fashion: the first move is
+	  searched serially to get a bound, the remaining moves are searched in parallel with it
+	- deeper in the tree it is a serial alpha-beta with fastest-first move ordering
+	- the stable disks of either side bound the final score, which cuts nodes off without
+	  searching them once alpha or beta is beyond that bound
+	- with an endgame cache file (egcache.h) the exact scores found are kept across runs
+	  and looked up before solving
+*/
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <cilk/cilk.h>
+#include <atomic>
+#include "bitboard.h"
+#include "stability.h"
+#include "counter.h"
+#include "egcache.h"
+
+/* below this many empties the solver no longer spawns */
+#define EG_SPLIT_EMPTIES 12
+
+/* below this many empties moves are searched in square order instead of fastest first */
+#define EG_SORT_EMPTIES 7
+
+/* solve the game exactly once at most this many squares are empty (0 turns the solver off) */
+int endgame_empties = 0;
+
+Counter endgame_nodes, stability_probes, stability_cutoffs;
+
+/* raises a bound shared by parallel brothers to score if it is higher */
+void RaiseBound(std::atomic<int> *bound, int score)
+{
+	int current = bound->load(std::memory_order_relaxed);
+	while (score > current && !bound->compare_exchange_weak(current, score, std::memory_order_relaxed)) {
+	}
+}
+
+/*
+	orders moves by the opponent's mobility after the move, fewest first.
+	corners get a bonus since they tend to refute early.
+*/
+int SortMoves(ull P, ull O, ull moves, int *squares)
+{
+	int keys[MAX_MOVES];
+	int n = 0;
+	for (; moves; moves &= moves - 1) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, P, O);
+		int key = PopCount(GetMoves(O & ~flips, P | flips | BB_SQUARE(sq))) * 2;
+		if (BB_SQUARE(sq) & 0x8100000000000081ULL) key -= 3;
+
+		int i = n++;
+		for (; i > 0 && keys[i - 1] > key; i--) {
+			keys[i] = keys[i - 1];
+			squares[i] = squares[i - 1];
+		}
+		keys[i] = key;
+		squares[i] = sq;
+	}
+	return n;
+}
+
+/*
+	try to prove the node fails low or high from the stable disks alone.
+	returns true along with the bound in *score when it does.
+*/
+bool StabilityCutoff(ull P, ull O, int alpha, int beta, int *score)
+{
+	/* O can have at most all its disks stable, so this is the best the bound can get */
+	if (alpha >= 64 - 2 * PopCount(O)) {
+		CounterAdd(&stability_probes, 1);
+		int upper = 64 - 2 * PopCount(StableDisks(O, P));
+		if (upper <= alpha) {
+			CounterAdd(&stability_cutoffs, 1);
+			*score = upper;
+			return true;
+		}
+	}
+	if (beta <= 2 * PopCount(P) - 64) {
+		CounterAdd(&stability_probes, 1);
+		int lower = 2 * PopCount(StableDisks(P, O)) - 64;
+		if (lower >= beta) {
+			CounterAdd(&stability_cutoffs, 1);
+			*score = lower;
+			return true;
+		}
+	}
+	return false;
+}
+
+int SolveEndgame(ull P, ull O, int alpha, int beta, bool passed)
+{
+	CounterAdd(&endgame_nodes, 1);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return PopCount(P) - PopCount(O);
+		return -SolveEndgame(O, P, -beta, -alpha, true);
+	}
+
+	int score, best_sq;
+	if (EGCacheProbe(P, O, &score, &best_sq)) return score;
+	if (StabilityCutoff(P, O, alpha, beta, &score)) return score;
+
+	int empties = 64 - PopCount(P | O);
+	int squares[MAX_MOVES];
+	int n = 0;
+	if (empties > EG_SORT_EMPTIES) n = SortMoves(P, O, moves, squares);
+	else for (; moves; moves &= moves - 1) squares[n++] = __builtin_ctzll(moves);
+
+	int alpha0 = alpha, best = -SCORE_INF;
+	for (int i = 0; i < n; i++) {
+		int sq = squares[i];
+		ull flips = GetFlips(sq, P, O);
+		score = -SolveEndgame(O & ~flips, P | flips | BB_SQUARE(sq), -beta, -alpha, false);
+		if (score > best) {
+			best = score;
+			best_sq = sq;
+			if (best > alpha) alpha = best;
+			if (alpha >= beta) break;
+		}
+	}
+	if (best > alpha0 && best < beta) EGCacheStore(P, O, best, best_sq);
+	return best;
+}
+
+/*
+	parallel solve. the eldest move establishes a bound, the others are then searched
+	concurrently with it; their scores are gathered in an array rather than a reducer
+	because the loop is short and every iteration owns its slot. a brother that improves
+	the bound raises the shared alpha that the brothers starting after it search with.
+*/
+int SolveEndgameParallel(ull P, ull O, int alpha, int beta, bool passed)
+{
+	if (64 - PopCount(P | O) <= EG_SPLIT_EMPTIES) return SolveEndgame(P, O, alpha, beta, passed);
+
+	CounterAdd(&endgame_nodes, 1);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return PopCount(P) - PopCount(O);
+		return -SolveEndgameParallel(O, P, -beta, -alpha, true);
+	}
+
+	int best, best_sq;
+	if (EGCacheProbe(P, O, &best, &best_sq)) return best;
+	if (StabilityCutoff(P, O, alpha, beta, &best)) return best;
+
+	int squares[MAX_MOVES], scores[MAX_MOVES];
+	int n = SortMoves(P, O, moves, squares);
+
+	int alpha0 = alpha;
+	ull flips = GetFlips(squares[0], P, O);
+	best = -SolveEndgameParallel(O & ~flips, P | flips | BB_SQUARE(squares[0]), -beta, -alpha, false);
+	best_sq = squares[0];
+	if (best > alpha) alpha = best;
+	if (alpha >= beta || n == 1) {
+		if (best > alpha0 && best < beta) EGCacheStore(P, O, best, best_sq);
+		return best;
+	}
+
+	std::atomic<int> shared_alpha(alpha);
+	cilk_for(int i = 1; i < n; i++) {
+		int a = shared_alpha.load(std::memory_order_relaxed);
+		if (a >= beta) {
+			scores[i] = -SCORE_INF;
+			continue;
+		}
+		ull f = GetFlips(squares[i], P, O);
+		scores[i] = -SolveEndgameParallel(O & ~f, P | f | BB_SQUARE(squares[i]), -beta, -a, false);
+		RaiseBound(&shared_alpha, scores[i]);
+	}
+	for (int i = 1; i < n; i++) {
+		if (scores[i] > best) {
+			best = scores[i];
+			best_sq = squares[i];
+		}
+	}
+	if (best > alpha0 && best < beta) EGCacheStore(P, O, best, best_sq);
+	return best;
+}
+
+/*
+	solves the position for the side to move and stores the best square in *best_sq
+	(-1 when there is no legal move). moves with the same score are broken the way
+	MoveComparison does it, towards the lowest row and then the lowest column, which is
+	the highest square index.
+*/
+int SolveEndgameRoot(ull P, ull O, int *best_sq)
+{
+	int squares[MAX_MOVES], scores[MAX_MOVES];
+	int n = SortMoves(P, O, GetMoves(P, O), squares);
+
+	/*
+		the root does not probe the cache: the best move stored for a position is the first
+		one of its score in the order it was solved in, which need not be the highest square
+		the tie break below picks. its moves are looked up instead, so the move played does
+		not depend on what the cache holds.
+	*/
+	*best_sq = -1;
+	int best;
+	if (n == 0) return -SolveEndgameParallel(O, P, -SCORE_INF, SCORE_INF, true);
+
+	ull flips = GetFlips(squares[0], P, O);
+	best = -SolveEndgameParallel(O & ~flips, P | flips | BB_SQUARE(squares[0]), -SCORE_INF, SCORE_INF, false);
+	*best_sq = squares[0];
+
+	/* a window starting just below best keeps the scores of equally good moves exact */
+	int alpha = best - 1;
+	cilk_for(int i = 1; i < n; i++) {
+		ull f = GetFlips(squares[i], P, O);
+		scores[i] = -SolveEndgameParallel(O & ~f, P | f | BB_SQUARE(squares[i]), -SCORE_INF, -alpha, false);
+	}
+	for (int i = 1; i < n; i++) {
+		if (scores[i] > best || (scores[i] == best && squares[i] > *best_sq)) {
+			best = scores[i];
+			*best_sq = squares[i];
+		}
+	}
+	EGCacheStore(P, O, best, *best_sq);
+	return best;
+}
+
+#endif
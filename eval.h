@@ -0,0 +1,187 @@
+/*
+	evaluation functions at the search horizon.
+
+	EVAL_DISC is the disk difference, as findDifference. EVAL_PATTERN sums the weights of
+	patterns fitted offline, see pattern.h, and EVAL_NNUE is a small neural network, see
+	nnue.h; both keep a state that the search updates move by move (EvalState).
+	EVAL_POSITIONAL weighs features that predict the final result better than the disks do
+	in the opening and midgame, each the value for the side to move minus the value for its
+	opponent:
+	- mobility: the number of legal moves
+	- frontier: the disks next to an empty square, which give the opponent moves later
+	  (potential mobility), so their weight is negative
+	- corners: the disks on the corners, which can never be flipped
+	- X and C squares: the disks on the squares diagonally and orthogonally next to an
+	  empty corner, which tend to give it away
+	- parity: 1 when the number of empty squares is odd, the side to move then normally
+	  plays the last move, -1 otherwise
+	- disks: the disk difference itself
+	The weights depend on the game stage, EVAL_STAGES stages by the number of disks on the
+	board, and can be read from a text file holding one stage per line:
+
+		stage mobility frontier corners x_squares c_squares parity disks
+
+	Lines starting with '#' are comments; the weights are in disks per unit of the feature,
+	eval.weights holds the defaults. The evaluation is rounded to disks and kept within the
+	score range of the search and the table.
+*/
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stdio.h>
+#include "bitboard.h"
+#include "nnue.h"
+#include "pattern.h"
+
+#define EVAL_DISC 0 // the disk difference
+#define EVAL_POSITIONAL 1 // the weighted features above
+#define EVAL_PATTERN 2 // the pattern tables of pattern.h
+#define EVAL_NNUE 3 // the network of nnue.h
+
+const char *eval_names[] = { "disc", "positional", "pattern", "nnue" };
+#define NEVAL_MODES 4
+int eval_mode = EVAL_DISC;
+
+/* what the incremental evaluations keep of a position, updated from one position to the next */
+typedef union { PatternIndexes patterns; NNUEAccumulator nnue; } EvalState;
+
+static inline bool EvalIncremental()
+{
+	return eval_mode == EVAL_PATTERN || eval_mode == EVAL_NNUE;
+}
+
+void EvalSetState(ull P, ull O, EvalState *state)
+{
+	if (eval_mode == EVAL_PATTERN) PatternSetIndexes(P, O, &state->patterns);
+	else NNUESetAccumulator(P, O, &state->nnue);
+}
+
+/* the state after the side to move plays sq flipping flips */
+void EvalMove(const EvalState *state, int sq, ull flips, EvalState *child)
+{
+	if (eval_mode == EVAL_PATTERN) PatternMove(&state->patterns, sq, flips, &child->patterns);
+	else NNUEMove(&state->nnue, sq, flips, &child->nnue);
+}
+
+void EvalPass(const EvalState *state, EvalState *child)
+{
+	if (eval_mode == EVAL_PATTERN) PatternPass(&state->patterns, &child->patterns);
+	else NNUEPass(&state->nnue, &child->nnue);
+}
+
+int EvaluateState(const EvalState *state, ull P, ull O)
+{
+	if (eval_mode == EVAL_PATTERN) return EvaluatePatternIndexes(&state->patterns, P, O);
+	return EvaluateNNUE(&state->nnue);
+}
+
+#define EVAL_STAGES 4
+#define EVAL_FEATURES 7
+
+/* the weights are kept in 1/EVAL_SCALE disks so that the evaluation is integer */
+#define EVAL_SCALE 64
+
+/* disks per unit of each feature in each stage, as in eval.weights */
+const double eval_default_weights[EVAL_STAGES][EVAL_FEATURES] = {
+	{ 1.00, -0.50, 8.0, -4.0, -2.0, 0.00, -0.25 },
+	{ 1.00, -0.50, 8.0, -4.0, -2.0, 0.50, 0.00 },
+	{ 0.75, -0.25, 8.0, -3.0, -1.5, 1.00, 0.25 },
+	{ 0.50, -0.10, 6.0, -2.0, -1.0, 1.50, 1.00 },
+};
+
+int eval_weights[EVAL_STAGES][EVAL_FEATURES];
+
+#define EVAL_CORNERS 0x8100000000000081ULL
+
+/* the X and C squares of each corner, in the order of the corners' bits 0, 7, 56 and 63 */
+static const ull eval_corner[4] = { 1ULL << 0, 1ULL << 7, 1ULL << 56, 1ULL << 63 };
+static const ull eval_x_square[4] = { 1ULL << 9, 1ULL << 14, 1ULL << 49, 1ULL << 54 };
+static const ull eval_c_squares[4] = {
+	1ULL << 1 | 1ULL << 8, 1ULL << 6 | 1ULL << 15, 1ULL << 48 | 1ULL << 57, 1ULL << 55 | 1ULL << 62
+};
+
+static inline int EvalWeight(double w)
+{
+	return (int) (w * EVAL_SCALE + (w < 0 ? -0.5 : 0.5));
+}
+
+void InitEval()
+{
+	for (int stage = 0; stage < EVAL_STAGES; stage++) {
+		for (int i = 0; i < EVAL_FEATURES; i++) eval_weights[stage][i] = EvalWeight(eval_default_weights[stage][i]);
+	}
+	InitPatterns();
+}
+
+/* stages split the 60 moves of a game evenly by the number of disks on the board */
+static inline int EvalStage(ull disks)
+{
+	int stage = (PopCount(disks) - 4) * EVAL_STAGES / 61;
+	return stage < EVAL_STAGES ? stage : EVAL_STAGES - 1;
+}
+
+bool LoadEvalWeights(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		printf("cannot open evaluation weights %s\n", path);
+		return false;
+	}
+
+	char line[256];
+	int lineno = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n') continue;
+
+		int stage;
+		double w[EVAL_FEATURES];
+		if (sscanf(line, "%d %lf %lf %lf %lf %lf %lf %lf", &stage, &w[0], &w[1], &w[2], &w[3], &w[4], &w[5], &w[6])
+			!= 1 + EVAL_FEATURES || stage < 0 || stage >= EVAL_STAGES) {
+			printf("%s:%d: bad evaluation weights\n", path, lineno);
+			fclose(f);
+			return false;
+		}
+		for (int i = 0; i < EVAL_FEATURES; i++) eval_weights[stage][i] = EvalWeight(w[i]);
+	}
+	fclose(f);
+	return true;
+}
+
+/* the disks of b next to an empty square */
+static inline ull Frontier(ull b, ull empty)
+{
+	ull next_to_empty = 0;
+	for (int dir = 0; dir < 8; dir++) next_to_empty |= BBShift(empty, dir);
+	return b & next_to_empty;
+}
+
+int EvaluatePositional(ull P, ull O)
+{
+	ull empty = ~(P | O);
+	ull x_squares = 0, c_squares = 0;
+	for (int i = 0; i < 4; i++) {
+		if (empty & eval_corner[i]) {
+			x_squares |= eval_x_square[i];
+			c_squares |= eval_c_squares[i];
+		}
+	}
+
+	int features[EVAL_FEATURES] = {
+		PopCount(GetMoves(P, O)) - PopCount(GetMoves(O, P)),
+		PopCount(Frontier(P, empty)) - PopCount(Frontier(O, empty)),
+		PopCount(P & EVAL_CORNERS) - PopCount(O & EVAL_CORNERS),
+		PopCount(P & x_squares) - PopCount(O & x_squares),
+		PopCount(P & c_squares) - PopCount(O & c_squares),
+		PopCount(empty) & 1 ? 1 : -1,
+		PopCount(P) - PopCount(O)
+	};
+	const int *w = eval_weights[EvalStage(P | O)];
+	int sum = 0;
+	for (int i = 0; i < EVAL_FEATURES; i++) sum += w[i] * features[i];
+
+	int score = (sum + (sum < 0 ? -EVAL_SCALE / 2 : EVAL_SCALE / 2)) / EVAL_SCALE;
+	return score < -64 ? -64 : score > 64 ? 64 : score;
+}
+
+#endif
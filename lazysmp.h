@@ -0,0 +1,66 @@
+/*
+	Lazy SMP: an alternative to splitting the tree between the cilk workers.
+
+	Every worker runs its own serial iterative deepening search of the same root and the
+	workers only share the transposition table. They start at staggered depths so that at
+	any time they are searching different iterations and fill the table for each other. The
+	first worker to complete the requested depth publishes its move and aborts the others.
+
+	SharedTableSearch runs the workers for any root search function; ABDADA (abdada.h) uses
+	it with its own root search and no staggering.
+*/
+#ifndef LAZYSMP_H
+#define LAZYSMP_H
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include "search.h"
+
+/* worker i starts its iterations at depth 1 + i % SMP_STAGGER */
+#define SMP_STAGGER 3
+
+/* searches the root to a depth, returning its score and best square like SearchRoot */
+typedef int (*RootSearch)(ull P, ull O, int depth, int *best_sq);
+
+void SharedTableWorker(ull P, ull O, int depth, int first_depth, RootSearch search, int *score, int *best_sq)
+{
+	for (int d = first_depth; d <= depth; d++) {
+		int sq;
+		int v = search(P, O, d, &sq);
+		if (search_abort.load(std::memory_order_relaxed)) return;
+		if (d == depth && !search_abort.exchange(true)) {
+			*score = v;
+			*best_sq = sq;
+		}
+	}
+}
+
+/*
+	the helpers are spawned first, the calling worker then searches in the continuation.
+	helpers never spawn, so with as many strands as workers each one ends up on its own
+	worker; with fewer workers they simply run one after the other and the first one to
+	finish still answers.
+*/
+int SharedTableSearch(ull P, ull O, int depth, int stagger, RootSearch search, int *best_sq)
+{
+	int nworkers = __cilkrts_get_nworkers();
+	int score = 0;
+
+	*best_sq = TT_NO_MOVE;
+	search_abort = false;
+	for (int i = 1; i < nworkers; i++) {
+		cilk_spawn SharedTableWorker(P, O, depth, 1 + i % stagger, search, &score, best_sq);
+	}
+	SharedTableWorker(P, O, depth, 1, search, &score, best_sq);
+	cilk_sync;
+	search_abort = false;
+
+	return score;
+}
+
+int LazySMPSearch(ull P, ull O, int depth, int *best_sq)
+{
+	return SharedTableSearch(P, O, depth, SMP_STAGGER, SearchRoot, best_sq);
+}
+
+#endif
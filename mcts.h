@@ -0,0 +1,396 @@
+/*
+	Monte-Carlo tree search player: UCT with random playouts, bounded by time instead of depth.
+
+	The workers search in root parallel fashion: each one grows its own tree from the root
+	for the allotted time, with its own random numbers, and the trees only meet at the end,
+	when the visits of every root move are added up over them. The move played is the one
+	visited most. Each tree owns its nodes and the visit counts of a worker's root go to its
+	own slot of an array, so the trees never synchronize while they grow.
+	- a playout plays uniformly random moves to the end of the game; a win counts 1, a draw
+	  1/2, for the side that moved into the node. a leaf is played out PLAYOUT_LANES times
+	  at once by the vector playouts of playout.h unless mcts_batch is off
+	- a node is expanded one random untried move at a time
+	- a side without a move passes, which is an edge of the tree like a move
+
+	With mcts_mode MCTS_TREE the workers grow a single shared tree instead, without locks:
+	- visits and wins are atomic counters. A worker counts its visits (one per playout of
+	  the leaf) on the way down and its results on the way up, so until then the visits
+	  count as losses (virtual loss) and the next worker down the same path is pushed to
+	  another branch
+	- a leaf is expanded after MCTS_EXPAND_VISITS playouts, or batches of playouts, by the
+	  worker that flips its state from unexpanded to expanding; it creates all the children
+	  at once in a contiguous block and publishes them with the state expanded. a worker
+	  that finds the leaf being expanded plays out from it
+	- nodes come from a pool allocated once, handed out by an atomic counter in blocks of
+	  children; once the pool is used up the tree stops growing
+*/
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include <utility>
+#include "bitboard.h"
+#include "counter.h"
+#include "playout.h"
+
+/* exploration constant of UCT */
+#define MCTS_C 1.0
+
+/* a tree stops expanding at this many nodes and only plays out from its leaves */
+#define MCTS_MAX_NODES (1 << 20)
+
+/* the clock is read once per this many playouts */
+#define MCTS_CLOCK_PLAYOUTS 64
+
+/* the move of a pass edge */
+#define MCTS_PASS 64
+
+#define MCTS_MAX_TREES 256
+
+/* the ways of spreading the tree search over the workers */
+#define MCTS_ROOT 0 // one tree per worker, the root visits added up at the end
+#define MCTS_TREE 1 // one shared tree with virtual loss
+
+const char *mcts_names[] = { "root", "tree" };
+#define NMCTS_MODES 2
+int mcts_mode = MCTS_ROOT;
+
+/* nodes in the pool of the shared tree */
+#define MCTS_POOL_NODES (1 << 21)
+
+/*
+	a leaf of the shared tree is expanded once it has been played out from this many times,
+	counting a batch of playouts as one
+*/
+#define MCTS_EXPAND_VISITS 4
+
+#define MCTS_UNEXPANDED 0
+#define MCTS_EXPANDING 1
+#define MCTS_EXPANDED 2
+
+typedef struct {
+	ull P, O;            // the side to move and its opponent
+	ull untried;         // moves not expanded yet
+	bool pass_untried;   // the side to move must pass and the pass is not expanded yet
+	int move;            // the move leading to the node
+	int parent, first_child, next_sibling;
+	ull visits;
+	double wins;         // for the side that moved into the node
+} MCTSNode;
+
+Counter mcts_playouts;
+
+/* plays out every leaf PLAYOUT_LANES times in one batch instead of once */
+bool mcts_batch = true;
+
+/*
+	plays out the position of a leaf, once or a batch at a time. returns the number of
+	playouts and counts their results in half points: *wins for the side that moved into
+	the leaf, *losses for the side to move there.
+*/
+int LeafPlayouts(ull P, ull O, ull *state, ull *wins, ull *losses)
+{
+	int scores[PLAYOUT_LANES];
+	int n = 1;
+	if (mcts_batch) {
+		ull p[PLAYOUT_LANES], o[PLAYOUT_LANES];
+		for (int i = 0; i < PLAYOUT_LANES; i++) {
+			p[i] = P;
+			o[i] = O;
+		}
+		BatchPlayout(p, o, state, scores);
+		n = PLAYOUT_LANES;
+	} else {
+		scores[0] = RandomPlayout(P, O, state);
+	}
+
+	*wins = *losses = 0;
+	for (int i = 0; i < n; i++) {
+		*wins += scores[i] < 0 ? 2 : scores[i] == 0 ? 1 : 0;
+		*losses += scores[i] > 0 ? 2 : scores[i] == 0 ? 1 : 0;
+	}
+	return n;
+}
+
+int MCTSAddNode(std::vector<MCTSNode> &tree, ull P, ull O, int move, int parent)
+{
+	MCTSNode n;
+	n.P = P;
+	n.O = O;
+	n.untried = GetMoves(P, O);
+	n.pass_untried = !n.untried && GetMoves(O, P);
+	n.move = move;
+	n.parent = parent;
+	n.first_child = -1;
+	n.next_sibling = -1;
+	n.visits = 0;
+	n.wins = 0;
+	tree.push_back(n);
+	if (parent >= 0) {
+		tree[tree.size() - 1].next_sibling = tree[parent].first_child;
+		tree[parent].first_child = tree.size() - 1;
+	}
+	return tree.size() - 1;
+}
+
+/* the child with the best upper confidence bound */
+int MCTSSelect(const std::vector<MCTSNode> &tree, int node)
+{
+	double log_visits = log((double) tree[node].visits);
+	int best = -1;
+	double best_value = -1;
+	for (int c = tree[node].first_child; c >= 0; c = tree[c].next_sibling) {
+		double value = tree[c].wins / tree[c].visits + MCTS_C * sqrt(log_visits / tree[c].visits);
+		if (value > best_value) {
+			best_value = value;
+			best = c;
+		}
+	}
+	return best;
+}
+
+double MCTSNow()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* grows one tree until the deadline, adding the visits of the root moves to visits[64] */
+void MCTSGrowTree(ull P, ull O, double deadline, ull seed, ull *visits)
+{
+	std::vector<MCTSNode> tree;
+	tree.reserve(1 << 16);
+	MCTSAddNode(tree, P, O, MCTS_PASS, -1);
+	ull state = seed;
+
+	for (ull playouts = 0; ; playouts++) {
+		if (playouts % MCTS_CLOCK_PLAYOUTS == 0 && MCTSNow() >= deadline) break;
+
+		/* selection */
+		int node = 0;
+		while (!tree[node].untried && !tree[node].pass_untried && tree[node].first_child >= 0) {
+			node = MCTSSelect(tree, node);
+		}
+
+		/* expansion */
+		if ((int) tree.size() < MCTS_MAX_NODES) {
+			MCTSNode &n = tree[node];
+			ull p = n.P, o = n.O;
+			if (n.untried) {
+				int sq = RandomSquare(n.untried, &state);
+				n.untried &= ~BB_SQUARE(sq);
+				ull flips = GetFlips(sq, p, o);
+				node = MCTSAddNode(tree, o & ~flips, p | flips | BB_SQUARE(sq), sq, node);
+			} else if (n.pass_untried) {
+				n.pass_untried = false;
+				node = MCTSAddNode(tree, o, p, MCTS_PASS, node);
+			}
+		}
+
+		/* simulation and backpropagation: the results alternate sides on every edge */
+		ull wins, losses;
+		int n = LeafPlayouts(tree[node].P, tree[node].O, &state, &wins, &losses);
+		for (; node >= 0; node = tree[node].parent) {
+			tree[node].visits += n;
+			tree[node].wins += wins / 2.0;
+			std::swap(wins, losses);
+		}
+	}
+
+	CounterAdd(&mcts_playouts, tree[0].visits);
+	for (int c = tree[0].first_child; c >= 0; c = tree[c].next_sibling) {
+		if (tree[c].move != MCTS_PASS) visits[tree[c].move] += tree[c].visits;
+	}
+}
+
+/* a node of the shared tree. wins count 2 for a win and 1 for a draw to stay integer */
+typedef struct {
+	ull P, O;
+	int move;
+	int first_child, nchildren;
+	std::atomic<int> state;
+	std::atomic<ull> visits, wins;
+} SharedNode;
+
+SharedNode *mcts_pool = NULL;
+std::atomic<int> mcts_pool_used(0);
+
+/* takes n contiguous nodes from the pool, -1 when it is used up */
+int SharedAlloc(int n)
+{
+	int first = mcts_pool_used.fetch_add(n, std::memory_order_relaxed);
+	return first + n <= MCTS_POOL_NODES ? first : -1;
+}
+
+void SharedInit(SharedNode *node, ull P, ull O, int move)
+{
+	node->P = P;
+	node->O = O;
+	node->move = move;
+	node->first_child = -1;
+	node->nchildren = 0;
+	node->state.store(MCTS_UNEXPANDED, std::memory_order_relaxed);
+	node->visits.store(0, std::memory_order_relaxed);
+	node->wins.store(0, std::memory_order_relaxed);
+}
+
+/* creates the children of a leaf this worker owns; a finished game gets none */
+void SharedExpand(SharedNode *node)
+{
+	ull moves = GetMoves(node->P, node->O);
+	int n = moves ? PopCount(moves) : GetMoves(node->O, node->P) ? 1 : 0;
+	int first = n ? SharedAlloc(n) : -1;
+	if (n && first < 0) {
+		/* the pool is used up: it stays a leaf for good, played out by whoever reaches it */
+		node->state.store(MCTS_EXPANDING, std::memory_order_release);
+		return;
+	}
+
+	if (!moves && n) SharedInit(&mcts_pool[first], node->O, node->P, MCTS_PASS);
+	for (int i = 0; moves; moves &= moves - 1, i++) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, node->P, node->O);
+		SharedInit(&mcts_pool[first + i], node->O & ~flips, node->P | flips | BB_SQUARE(sq), sq);
+	}
+	node->first_child = first;
+	node->nchildren = n;
+	node->state.store(MCTS_EXPANDED, std::memory_order_release);
+}
+
+/* the child with the best upper confidence bound, counting the visits still under way as losses */
+int SharedSelect(SharedNode *node)
+{
+	double log_visits = log((double) node->visits.load(std::memory_order_relaxed) + 1);
+	int best = node->first_child;
+	double best_value = -1;
+	for (int c = node->first_child; c < node->first_child + node->nchildren; c++) {
+		ull visits = mcts_pool[c].visits.load(std::memory_order_relaxed);
+		/* children nobody has visited yet go first */
+		if (visits == 0) return c;
+		double value = mcts_pool[c].wins.load(std::memory_order_relaxed) / (2.0 * visits)
+			+ MCTS_C * sqrt(log_visits / visits);
+		if (value > best_value) {
+			best_value = value;
+			best = c;
+		}
+	}
+	return best;
+}
+
+/* one worker's playouts on the shared tree until the deadline */
+void SharedGrow(double deadline, ull seed)
+{
+	ull state = seed;
+	int path[128];
+	int lanes = mcts_batch ? PLAYOUT_LANES : 1;
+
+	for (ull playouts = 0; ; playouts++) {
+		if (playouts % MCTS_CLOCK_PLAYOUTS == 0 && MCTSNow() >= deadline) break;
+
+		int node = 0, depth = 0;
+		path[depth++] = node;
+		mcts_pool[node].visits.fetch_add(lanes, std::memory_order_relaxed);
+		for (;;) {
+			SharedNode *n = &mcts_pool[node];
+			int s = n->state.load(std::memory_order_acquire);
+			if (s == MCTS_UNEXPANDED && (node == 0 || n->visits.load(std::memory_order_relaxed) > (ull) MCTS_EXPAND_VISITS * lanes)) {
+				int expected = MCTS_UNEXPANDED;
+				if (n->state.compare_exchange_strong(expected, MCTS_EXPANDING, std::memory_order_acquire)) {
+					SharedExpand(n);
+					s = n->state.load(std::memory_order_relaxed);
+				}
+			}
+			if (s != MCTS_EXPANDED || n->nchildren == 0) break;
+			node = SharedSelect(n);
+			mcts_pool[node].visits.fetch_add(lanes, std::memory_order_relaxed);
+			path[depth++] = node;
+		}
+
+		ull wins, losses;
+		LeafPlayouts(mcts_pool[node].P, mcts_pool[node].O, &state, &wins, &losses);
+		for (int i = depth - 1; i >= 0; i--) {
+			if (wins) mcts_pool[path[i]].wins.fetch_add(wins, std::memory_order_relaxed);
+			std::swap(wins, losses);
+		}
+	}
+}
+
+/* allocates the node pool of the shared tree once, before the first SharedSearch */
+bool MCTSInit()
+{
+	if (mcts_pool) return true;
+	mcts_pool = (SharedNode *) calloc(MCTS_POOL_NODES, sizeof(SharedNode));
+	if (!mcts_pool) {
+		printf("cannot allocate the %d node pool of the shared MCTS tree\n", MCTS_POOL_NODES);
+		return false;
+	}
+	return true;
+}
+
+/* the shared tree counterpart of MCTSSearch, the pool allocated by MCTSInit */
+void SharedSearch(ull P, ull O, int millis, ull *visits)
+{
+	mcts_pool_used.store(1, std::memory_order_relaxed);
+	SharedInit(&mcts_pool[0], P, O, MCTS_PASS);
+
+	int nworkers = __cilkrts_get_nworkers();
+	double deadline = MCTSNow() + millis / 1000.0;
+	cilk_for(int w = 0; w < nworkers; w++) {
+		SharedGrow(deadline, (0x9e3779b97f4a7c15ULL * (w + 1) ^ P ^ O * 3) | 1);
+	}
+
+	CounterAdd(&mcts_playouts, mcts_pool[0].visits.load(std::memory_order_relaxed));
+	SharedNode *root = &mcts_pool[0];
+	if (root->state.load(std::memory_order_acquire) != MCTS_EXPANDED) return;
+	for (int c = root->first_child; c < root->first_child + root->nchildren; c++) {
+		if (mcts_pool[c].move != MCTS_PASS) visits[mcts_pool[c].move] += mcts_pool[c].visits.load(std::memory_order_relaxed);
+	}
+}
+
+/*
+	searches the position for the given time as mcts_mode says and stores the most visited
+	move in *best_sq (-1 without a legal move), ties broken towards the highest square.
+	returns the number of playouts.
+*/
+ull MCTSSearch(ull P, ull O, int millis, int *best_sq)
+{
+	*best_sq = -1;
+	if (!GetMoves(P, O)) return 0;
+
+	int ntrees = __cilkrts_get_nworkers();
+	if (ntrees > MCTS_MAX_TREES) ntrees = MCTS_MAX_TREES;
+	std::vector<ull> visits(ntrees * 64, 0);
+	double deadline = MCTSNow() + millis / 1000.0;
+	ull start = CounterTotal(&mcts_playouts);
+
+	if (mcts_mode == MCTS_TREE) {
+		SharedSearch(P, O, millis, &visits[0]);
+	} else {
+		cilk_for(int t = 0; t < ntrees; t++) {
+			ull seed = (0x9e3779b97f4a7c15ULL * (t + 1) ^ P ^ O * 3) | 1;
+			MCTSGrowTree(P, O, deadline, seed, &visits[t * 64]);
+		}
+	}
+
+	/* a legal move has at least 0 visits, so one is always picked */
+	ull best_visits = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		ull total = 0;
+		for (int t = 0; t < ntrees; t++) total += visits[t * 64 + sq];
+		if ((GetMoves(P, O) & BB_SQUARE(sq)) && total >= best_visits) {
+			best_visits = total;
+			*best_sq = sq;
+		}
+	}
+	return CounterTotal(&mcts_playouts) - start;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+	multi-PV analysis: an exact score for every legal root move instead of just the best one.
+
+	Every iteration of the deepening searches all root moves in parallel with SearchParallel
+	and the shared transposition table. From the second iteration on each move is first
+	searched with a narrow window around its previous score and searched again with the full
+	window only when the score falls outside it. The moves come back sorted best first, ties
+	broken towards the highest square as MoveComparison does, so the first one is the move
+	findBestMove would play. The principal variation of a move is read back from the table.
+*/
+#ifndef MULTIPV_H
+#define MULTIPV_H
+
+#include <cilk/cilk.h>
+#include <utility>
+#include "search.h"
+
+/* half width of the window around the score of the previous iteration */
+#define MULTIPV_WINDOW 2
+
+/* longest principal variation kept for a root move, in plies */
+#define MULTIPV_MAX_PV 32
+
+/* a pass in a principal variation */
+#define MULTIPV_PASS -1
+
+/* number of root moves whose principal variation is printed (0 turns the analysis off) */
+int multipv_lines = 0;
+
+typedef struct { int sq; int score; int npv; int pv[MULTIPV_MAX_PV]; } RootMove;
+
+/* searches the position after the root move exactly, trying a window around guess first */
+int MultiPVScore(ull P, ull O, int sq, int depth, int guess, bool use_guess)
+{
+	ull flips = GetFlips(sq, P, O);
+	ull child_P = O & ~flips, child_O = P | flips | BB_SQUARE(sq);
+
+	if (use_guess) {
+		int alpha = guess - MULTIPV_WINDOW, beta = guess + MULTIPV_WINDOW;
+		int score = -SearchParallel(child_P, child_O, -beta, -alpha, depth - 1, false);
+		if (score > alpha && score < beta) return score;
+	}
+	return -SearchParallel(child_P, child_O, -SCORE_INF, SCORE_INF, depth - 1, false);
+}
+
+/* follows the table moves from the position after the root move */
+void MultiPVLine(ull P, ull O, int depth, RootMove *m)
+{
+	m->pv[0] = m->sq;
+	m->npv = 1;
+
+	ull flips = GetFlips(m->sq, P, O);
+	ull p = O & ~flips, o = P | flips | BB_SQUARE(m->sq);
+	for (int d = depth - 1; d > 0 && m->npv < MULTIPV_MAX_PV; d--) {
+		ull moves = GetMoves(p, o);
+		if (!moves) {
+			if (!GetMoves(o, p)) break;
+			m->pv[m->npv++] = MULTIPV_PASS;
+			std::swap(p, o);
+			d++;
+			continue;
+		}
+		TTData data;
+		if (!TTProbe(p, o, &data) || data.move == TT_NO_MOVE || !(moves & BB_SQUARE(data.move))) break;
+		m->pv[m->npv++] = data.move;
+		flips = GetFlips(data.move, p, o);
+		ull mover = p | flips | BB_SQUARE(data.move);
+		p = o & ~flips;
+		o = mover;
+	}
+}
+
+/*
+	scores every legal root move to depth and fills moves, best first. returns the number
+	of moves; a position without a legal move has none.
+*/
+int MultiPVSearch(ull P, ull O, int depth, RootMove *moves)
+{
+	int n = 0;
+	for (ull legal = GetMoves(P, O); legal; legal &= legal - 1) {
+		moves[n].sq = __builtin_ctzll(legal);
+		moves[n].score = 0;
+		n++;
+	}
+
+	for (int d = 1; d <= depth; d++) {
+		cilk_for(int i = 0; i < n; i++) {
+			moves[i].score = MultiPVScore(P, O, moves[i].sq, d, moves[i].score, d > 1);
+		}
+	}
+
+	for (int i = 1; i < n; i++) {
+		RootMove m = moves[i];
+		int j = i;
+		for (; j > 0 && (moves[j - 1].score < m.score || (moves[j - 1].score == m.score && moves[j - 1].sq < m.sq)); j--) {
+			moves[j] = moves[j - 1];
+		}
+		moves[j] = m;
+	}
+	if (n > 0) TTStore(P, O, depth, -SCORE_INF, SCORE_INF, moves[0].score, moves[0].sq);
+
+	cilk_for(int i = 0; i < n; i++) {
+		MultiPVLine(P, O, depth, &moves[i]);
+	}
+	return n;
+}
+
+#endif
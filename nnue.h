@@ -0,0 +1,228 @@
+/*
+	neural network evaluation (--eval=nnue), small and efficiently updatable as in the NNUE
+	evaluators of chess and shogi engines, on the CPU only.
+
+	The inputs are the two bitboards seen from one side: 64 inputs for its own disks and 64
+	for its opponent's. The first layer maps them to NNUE_HIDDEN values, and since an input
+	is 0 or 1 this is a sum of the weight columns of the disks on the board, the
+	accumulator. It is kept for both sides and, like the pattern indexes, carried down the
+	serial search: a move adds the column of the square played and moves the columns of the
+	flipped disks from one side to the other, instead of summing 64 columns at each leaf.
+	The network then is
+		a1 = clip(accumulator of the side to move, accumulator of its opponent)  2 * NNUE_HIDDEN
+		a2 = clip(W2 a1 + b2)                                                 NNUE_L2
+		score = W3 a2 + b3
+	with clip(x) = min(max(x, 0), 1). It is quantized for integer arithmetic:
+	- the first layer in int16, 1.0 being NNUE_QA, so that a clipped value fits in a uint8
+	- the second layer in int8 weights of 1/NNUE_QB and int32 biases, its sums shifted back
+	  to NNUE_QA
+	- the output layer in int16 weights of 1/NNUE_QB and an int32 bias, the score in disks
+	  being its sum divided by NNUE_QA * NNUE_QB
+	With AVX2 at run time the second layer multiplies the 128 uint8 by the int8 weights 32 at
+	a time (vpmaddubsw) and sums 8 outputs in one register; without it the same arithmetic
+	is scalar, the reference of the vector code.
+
+	The weights are trained offline and read from a binary file:
+
+		char magic[8] = "OTHNNUE1"; ull hidden; ull l2;
+		short w1[128][hidden]; short b1[hidden];
+		signed char w2[l2][2 * hidden]; int b2[l2];
+		short w3[l2]; int b3;
+
+	in the byte order of the machine, w1 being indexed by the own disks' squares and then by
+	64 plus the opponent's.
+*/
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <immintrin.h>
+#include "bitboard.h"
+
+#define NNUE_MAGIC "OTHNNUE1"
+
+#define NNUE_INPUTS 128
+#define NNUE_HIDDEN 64
+#define NNUE_L2 32
+
+#define NNUE_QA 127
+
+/* the second layer weights are in 1/NNUE_QB, a power of 2 so that its sums are shifted back */
+#define NNUE_QB_SHIFT 6
+#define NNUE_QB (1 << NNUE_QB_SHIFT)
+
+typedef struct { char magic[8]; ull hidden; ull l2; } NNUEHeader;
+
+typedef struct {
+	short w1[NNUE_INPUTS][NNUE_HIDDEN] __attribute__((aligned(32)));
+	short b1[NNUE_HIDDEN] __attribute__((aligned(32)));
+	signed char w2[NNUE_L2][2 * NNUE_HIDDEN] __attribute__((aligned(32)));
+	int b2[NNUE_L2] __attribute__((aligned(32)));
+	short w3[NNUE_L2] __attribute__((aligned(32)));
+	int b3;
+} NNUEWeights;
+
+NNUEWeights nnue;
+bool nnue_loaded = false;
+
+/* whether the second layer runs the AVX2 code, decided once from the CPU by LoadNNUE */
+int nnue_avx2 = 0;
+
+/* the first layer for each side, [0] for the side to move and [1] for its opponent */
+typedef struct { short acc[2][NNUE_HIDDEN] __attribute__((aligned(32))); } NNUEAccumulator;
+
+static bool NNUERead(FILE *f, void *p, size_t size)
+{
+	return fread(p, 1, size, f) == size;
+}
+
+bool LoadNNUE(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		printf("cannot open network weights %s\n", path);
+		return false;
+	}
+	NNUEHeader header;
+	bool ok = NNUERead(f, &header, sizeof(header)) && memcmp(header.magic, NNUE_MAGIC, 8) == 0
+		&& header.hidden == NNUE_HIDDEN && header.l2 == NNUE_L2
+		&& NNUERead(f, nnue.w1, sizeof(nnue.w1)) && NNUERead(f, nnue.b1, sizeof(nnue.b1))
+		&& NNUERead(f, nnue.w2, sizeof(nnue.w2)) && NNUERead(f, nnue.b2, sizeof(nnue.b2))
+		&& NNUERead(f, nnue.w3, sizeof(nnue.w3)) && NNUERead(f, &nnue.b3, sizeof(nnue.b3)) && fgetc(f) == EOF;
+	fclose(f);
+	if (!ok) {
+		printf("%s are not network weights of %d hidden and %d second layer values\n", path, NNUE_HIDDEN, NNUE_L2);
+		return false;
+	}
+	nnue_loaded = true;
+	nnue_avx2 = __builtin_cpu_supports("avx2");
+	return true;
+}
+
+void NNUESetAccumulator(ull P, ull O, NNUEAccumulator *a)
+{
+	for (int side = 0; side < 2; side++) {
+		ull own = side == 0 ? P : O, other = side == 0 ? O : P;
+		short *acc = a->acc[side];
+		memcpy(acc, nnue.b1, sizeof(nnue.b1));
+		for (; own; own &= own - 1) {
+			const short *w = nnue.w1[__builtin_ctzll(own)];
+			for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] += w[i];
+		}
+		for (; other; other &= other - 1) {
+			const short *w = nnue.w1[64 + __builtin_ctzll(other)];
+			for (int i = 0; i < NNUE_HIDDEN; i++) acc[i] += w[i];
+		}
+	}
+}
+
+/*
+	the accumulator after the side to move plays sq flipping flips, for the opponent who
+	moves next: the mover's side gains the own column of sq and swaps the opponent's columns
+	of the flipped disks for its own, the opponent's side the other way around.
+*/
+void NNUEMove(const NNUEAccumulator *a, int sq, ull flips, NNUEAccumulator *child)
+{
+	short *mover = child->acc[1], *other = child->acc[0];
+	memcpy(mover, a->acc[0], sizeof(a->acc[0]));
+	memcpy(other, a->acc[1], sizeof(a->acc[1]));
+	const short *own = nnue.w1[sq], *opp = nnue.w1[64 + sq];
+	for (int i = 0; i < NNUE_HIDDEN; i++) {
+		mover[i] += own[i];
+		other[i] += opp[i];
+	}
+	for (; flips; flips &= flips - 1) {
+		int f = __builtin_ctzll(flips);
+		own = nnue.w1[f];
+		opp = nnue.w1[64 + f];
+		for (int i = 0; i < NNUE_HIDDEN; i++) {
+			mover[i] += own[i] - opp[i];
+			other[i] += opp[i] - own[i];
+		}
+	}
+}
+
+/* the accumulator after a pass, the sides swapped */
+void NNUEPass(const NNUEAccumulator *a, NNUEAccumulator *child)
+{
+	memcpy(child->acc[0], a->acc[1], sizeof(a->acc[1]));
+	memcpy(child->acc[1], a->acc[0], sizeof(a->acc[0]));
+}
+
+static inline int NNUEClip(int x)
+{
+	return x < 0 ? 0 : x > NNUE_QA ? NNUE_QA : x;
+}
+
+/* the output of the network in 1/(NNUE_QA * NNUE_QB) disks */
+int NNUEForwardScalar(const NNUEAccumulator *a)
+{
+	unsigned char a1[2 * NNUE_HIDDEN];
+	for (int side = 0; side < 2; side++) {
+		for (int i = 0; i < NNUE_HIDDEN; i++) a1[side * NNUE_HIDDEN + i] = NNUEClip(a->acc[side][i]);
+	}
+	int out = nnue.b3;
+	for (int j = 0; j < NNUE_L2; j++) {
+		int sum = nnue.b2[j];
+		for (int i = 0; i < 2 * NNUE_HIDDEN; i++) sum += a1[i] * nnue.w2[j][i];
+		out += NNUEClip(sum >> NNUE_QB_SHIFT) * nnue.w3[j];
+	}
+	return out;
+}
+
+/* the 8 sums of the 8 int32 vectors v, in order */
+__attribute__((target("avx2")))
+static inline __m256i NNUEHadd8(const __m256i *v)
+{
+	__m256i s0 = _mm256_hadd_epi32(_mm256_hadd_epi32(v[0], v[1]), _mm256_hadd_epi32(v[2], v[3]));
+	__m256i s1 = _mm256_hadd_epi32(_mm256_hadd_epi32(v[4], v[5]), _mm256_hadd_epi32(v[6], v[7]));
+	return _mm256_add_epi32(_mm256_permute2x128_si256(s0, s1, 0x20), _mm256_permute2x128_si256(s0, s1, 0x31));
+}
+
+__attribute__((target("avx2")))
+int NNUEForwardAVX2(const NNUEAccumulator *a)
+{
+	/* packus saturates to 0..255 per 128 bit lane, the permute puts the lanes back in order */
+	__m256i a1[4];
+	const __m256i qa = _mm256_set1_epi8(NNUE_QA);
+	for (int k = 0; k < 4; k++) {
+		const short *acc = a->acc[k / 2] + (k % 2) * 32;
+		__m256i lo = _mm256_loadu_si256((const __m256i *) acc), hi = _mm256_loadu_si256((const __m256i *) (acc + 16));
+		a1[k] = _mm256_min_epu8(_mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8), qa);
+	}
+
+	/* 127 * 128 * 2 fits the int16 pairs of vpmaddubsw, vpmaddwd then sums them to int32 */
+	const __m256i ones = _mm256_set1_epi16(1);
+	__m256i out = _mm256_setzero_si256();
+	for (int j0 = 0; j0 < NNUE_L2; j0 += 8) {
+		__m256i sums[8];
+		for (int j = 0; j < 8; j++) {
+			const __m256i *w = (const __m256i *) nnue.w2[j0 + j];
+			__m256i s = _mm256_setzero_si256();
+			for (int k = 0; k < 4; k++) {
+				s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_maddubs_epi16(a1[k], _mm256_load_si256(w + k)), ones));
+			}
+			sums[j] = s;
+		}
+		__m256i l2 = _mm256_add_epi32(NNUEHadd8(sums), _mm256_load_si256((const __m256i *) (nnue.b2 + j0)));
+		l2 = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(l2, NNUE_QB_SHIFT), _mm256_setzero_si256()), _mm256_set1_epi32(NNUE_QA));
+		__m256i w3 = _mm256_cvtepi16_epi32(_mm_load_si128((const __m128i *) (nnue.w3 + j0)));
+		out = _mm256_add_epi32(out, _mm256_mullo_epi32(l2, w3));
+	}
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return nnue.b3 + _mm_cvtsi128_si32(s);
+}
+
+/* the evaluation from the accumulator of the position, rounded to disks and kept in the score range */
+int EvaluateNNUE(const NNUEAccumulator *a)
+{
+	int out = nnue_avx2 ? NNUEForwardAVX2(a) : NNUEForwardScalar(a);
+	const int q = NNUE_QA * NNUE_QB;
+	int score = (out + (out < 0 ? -q / 2 : q / 2)) / q;
+	return score < -64 ? -64 : score > 64 ? 64 : score;
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <cilk/reducer_opadd.h>
 #include <cilk/reducer_opor.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <iostream>
 #include <climits> // for UULONG_MAX
@@ -13,6 +14,21 @@
 #include <cilk/reducer_list.h>
 #include <vector>
 #include <utility> // for using std::pair
+#include <getopt.h>
+#include "bitboard.h"
+#include "endgame.h"
+#include "search.h"
+#include "lazysmp.h"
+#include "abdada.h"
+#include "multipv.h"
+#include "budget.h"
+#include "perft.h"
+#include "mcts.h"
+#include "book.h"
+#include "bookbuild.h"
+#include "selfplay.h"
+#include "train.h"
+#include "dfpn.h"
 using namespace std;
 
 double execution_time = 0;
@@ -23,8 +39,18 @@ int VERBOSE = 1;
 #define O_WHITE 1
 #define OTHERCOLOR(c) (1-(c))
 
+/* how the computer's search is spread over the cilk workers */
+#define PARALLEL_CILK 0 // young brothers wait splitting of the tree (SearchParallel)
+#define PARALLEL_LAZYSMP 1 // whole searches side by side sharing the table (LazySMPSearch)
+#define PARALLEL_ABDADA 2 // whole searches side by side deferring busy moves (ABDADASearch)
+
+const char *parallel_names[] = { "cilk", "lazysmp", "abdada" };
+#define NPARALLEL_MODES 3
+int parallel_mode = PARALLEL_CILK;
+
 #define HUMAN 'h' // to identify player as human
 #define COMPUTER 'c' // to identify player as computer 
+#define MCTS 'm' // to identify player as computer searching with Monte-Carlo tree search
 
 #define BOARD_BIT_INDEX(row,col) ((8 - (row)) * 8 + (8 - (col)))
 #define BOARD_BIT(row,col) (0x1LL << BOARD_BIT_INDEX(row,col))
@@ -61,12 +87,13 @@ typedef struct { int row; int col; } Move;
 
 /*
 	Player class that recognizes each player in the Reversi game
-	- type - to identify if the player is computer or human
+	- type - to identify if the player is computer, MCTS or human
 	- color - to identify the color chosen by the player X or O
 	- move_possible - to identify if there is a further move is possible by the player
 	- depth - (only for computer player) The search depth to evaluate which maximizes its winning probability 
+	- millis - (only for MCTS player) The time in milliseconds the tree search gets for each move
 */
-typedef struct { char type; int color; bool move_possible; int depth;} Player;
+typedef struct { char type; int color; bool move_possible; int depth; int millis;} Player;
 
 
 Board start = { 
@@ -84,6 +111,13 @@ Move offsets[] = {
 int noffsets = sizeof(offsets)/sizeof(Move);
 char diskcolor[] = { '.', 'X', 'O', 'I' };
 
+/* converts a bit index of the board back into a Move */
+Move SquareToMove(int sq)
+{
+	Move m = {SQUARE_ROW(sq), SQUARE_COL(sq)};
+	return m;
+}
+
 /* helper functions to print board configuration */
 void PrintDisk(int x_black, int o_white)
 {
@@ -337,68 +371,181 @@ bool isStartMove(Move m){
 	return (m.row == -1 and m.col == -1);
 }
 
+/* searches the root moves to the given depth with the young brothers wait scheme of SearchParallel.
+	The first move, the best one of the previous iteration when the table has it, is searched 
+	alone to get the best diff so far; the other moves are then searched in parallel with a 
+	window starting just below it, so a move that ties with the best one still gets its exact 
+	diff and best_move_reducer can break the tie.
+*/
+int searchRootMoves(ull P, ull O, ull legal_moves, int depth, Move &best_move){
+
+	Move no_move = {-1, -1};
+	TTData d;
+	int squares[MAX_MOVES];
+	int num_moves = OrderMoves(P, O, legal_moves, depth, TTProbe(P, O, &d) ? d.move : TT_NO_MOVE, squares);
+
+	cilk::reducer_max<pair<Move, int>, MoveComparison> best_move_reducer;
+	/* initialize this reducer so that it doesn't throw garbage values */
+	best_move_reducer.calc_max({no_move, -SCORE_INF});
+
+	ull flips = GetFlips(squares[0], P, O);
+	int first_diff = -SearchParallel(O & ~flips, P | flips | BB_SQUARE(squares[0]), -SCORE_INF, SCORE_INF, depth - 1, false);
+	best_move_reducer.calc_max({SquareToMove(squares[0]), first_diff});
+
+	cilk_for(int i = 1; i < num_moves; i++) {
+		ull f = GetFlips(squares[i], P, O);
+		int diff = -SearchParallel(O & ~f, P | f | BB_SQUARE(squares[i]), -SCORE_INF, -(first_diff - 1), depth - 1, false);
+		best_move_reducer.calc_max({SquareToMove(squares[i]), diff});
+	}
+
+	/* store the corresponding move and return its difference */
+	best_move = best_move_reducer.get_value().first;
+	int best_diff = best_move_reducer.get_value().second;
+	if(!search_abort.load(std::memory_order_relaxed)) {
+		TTStore(P, O, depth, -SCORE_INF, SCORE_INF, best_diff, BOARD_BIT_INDEX(best_move.row, best_move.col));
+	}
+	return best_diff;
+}
+
 /* finds best move by the computer.
 	b - current board config
 	color - color of the player
-	depth - current depth of the iteration in the search tree 
 	search_depth - max search depth provided by the user 
-	mul - factor by which the best diff has to be multiplied to return the diff to the parent. This is in 
-		context with negamax algorithm. The max for player is -1*(max of opponent) assuming both play optimally.
-	is_prev_skipped - to check if the previous iteration was skipped. If yes then we halt the search else continue
-		skipping the player's turn 
 	best_move - a pointer to store the best move for the given search params.
+
+	The search deepens one ply at a time up to search_depth, so that the table orders the 
+	moves of each iteration with the results of the previous one. How the work is spread over
+	the workers depends on parallel_mode.
 */
-int findBestMove(Board b, int color, int depth, int search_depth, int mul, bool is_prev_skipped, Move &best_move){
+int findBestMove(Board b, int color, int search_depth, Move &best_move){
 
-	Move no_move = {-1, -1};
 	Board legal_moves = {0,0};
 	int num_moves = EnumerateLegalMoves(b, color, &legal_moves);	
 	
-	cilk::reducer_max<int> best_diff;
-	cilk::reducer_max<pair<Move, int>, MoveComparison> best_move_reducer;
-	int max_diff = -65;
-	/* initialize this reducer so that it doesn't throw garbage values */
+	/* there is no move to search: the turn is skipped */
+	if(num_moves == 0) return findDifference(b, color);
+
+	ull P = b.disks[color], O = b.disks[OTHERCOLOR(color)];
+	if(parallel_mode == PARALLEL_LAZYSMP || parallel_mode == PARALLEL_ABDADA) {
+		int best_sq;
+		int diff = parallel_mode == PARALLEL_LAZYSMP ? LazySMPSearch(P, O, search_depth, &best_sq)
+			: ABDADASearch(P, O, search_depth, &best_sq);
+		best_move = SquareToMove(best_sq);
+		return diff;
+	}
 
-	best_move_reducer.calc_max({no_move, max_diff});	
-	
-	cilk_for(int i = 0; i < num_moves; i++) {
-		ull legal_moves_ull = legal_moves.disks[color];
-		/* this conversion is needed to get a Move from bit config */
-		for(int j=0; j < i; j++){		
-			legal_moves_ull ^= (1LL << __builtin_ctzll(legal_moves_ull));
-		}
-		int lowestSetBit =  __builtin_ctzll(legal_moves_ull);
-		Move legal_move = {8-lowestSetBit/8, 8-lowestSetBit%8};
-		
-		if (!isOccupied(&b, legal_move)) {
-			Board boardAfterMove = b;
-			int nflips = FlipDisks(legal_move, &boardAfterMove, color, 0, 1);
-			if(nflips == 0) continue;
-			PlaceOrFlip(legal_move, &boardAfterMove, color);
-			int diff;                      
-			if(search_depth==depth) {
-				diff = findDifference(boardAfterMove, color);
-			}
-			else {
-				diff = findBestMove(boardAfterMove, OTHERCOLOR(color), depth+1, search_depth, -1, false, best_move);	  	  	  
+	int diff = 0;
+	for(int depth = 1; depth <= search_depth; depth++) {
+		diff = searchRootMoves(P, O, legal_moves.disks[color], depth, best_move);
+	}
+	return diff;
+}
+
+/*
+	prints the analysis of the computer's move, one line per legal move, best first:
+	multipv player=P depth=D rank=R move=ROW,COL score=S [pv=ROW,COL ROW,COL pass ...]
+	the principal variation is only printed for the first multipv_lines moves.
+*/
+void PrintMultiPV(int color, int depth, const RootMove *moves, int n)
+{
+	for(int i = 0; i < n; i++) {
+		Move m = SquareToMove(moves[i].sq);
+		printf("multipv player=%d depth=%d rank=%d move=%d,%d score=%d", color + 1, depth, i + 1, m.row, m.col,
+			moves[i].score);
+		if(i < multipv_lines) {
+			printf(" pv=");
+			for(int j = 0; j < moves[i].npv; j++) {
+				if(j > 0) printf(" ");
+				if(moves[i].pv[j] == MULTIPV_PASS) printf("pass");
+				else printf("%d,%d", SQUARE_ROW(moves[i].pv[j]), SQUARE_COL(moves[i].pv[j]));
 			}
-			best_diff.calc_max(diff);				 
-            if(depth==1) best_move_reducer.calc_max({legal_move, diff});
-    	}
-    }
-	
-		
-	if(num_moves == 0) {	
-		if(is_prev_skipped){
-			best_diff.calc_max(findDifference(b,color));
 		}
+		printf("\n");
+	}
+}
+
+/*
+	pondering: while the human thinks, the computer guesses the human's move and searches its
+	own reply to it. the guessed position, the search's progress and whether the guess came
+	true once the human moved.
+*/
+typedef struct { Board board; int color; int depth; bool done; Move move; bool hit; } Ponder;
+
+bool ponder = false;
+Ponder pondering = { {{0, 0}}, 0, 0, false, {-1, -1}, false };
+int ponder_hits = 0, ponder_misses = 0;
+
+/* moves searched to a node budget and the sum of the depths they reached */
+int budget_moves = 0, budget_depth_sum = 0;
+
+/* guesses the reply of the side to move: the move in the table, else the first one fastest first */
+int PredictMove(ull P, ull O)
+{
+	ull moves = GetMoves(P, O);
+	TTData d;
+	if(TTProbe(P, O, &d) && d.move != TT_NO_MOVE && (moves & BB_SQUARE(d.move))) return d.move;
+	int squares[MAX_MOVES];
+	SortMoves(P, O, moves, squares);
+	return squares[0];
+}
+
+/*
+	searches the guessed position as findBestMove does in cilk mode. the human's move aborts
+	it through search_abort; the iterations finished by then stay in the table.
+*/
+void PonderSearch(Ponder *p)
+{
+	Board legal_moves = {0,0};
+	if(EnumerateLegalMoves(p->board, p->color, &legal_moves) == 0) return;
 
-		else best_diff.calc_max(findBestMove(b, OTHERCOLOR(color), depth, search_depth, -1, true, best_move));
+	ull P = p->board.disks[p->color], O = p->board.disks[OTHERCOLOR(p->color)];
+	Move m;
+	for(int depth = 1; depth <= p->depth; depth++) {
+		searchRootMoves(P, O, legal_moves.disks[p->color], depth, m);
+		if(search_abort.load(std::memory_order_relaxed)) return;
 	}
-	
-	/* store the corresponding moves and return the difference by multiplying with the given multiplier*/
-	if(depth==1) best_move = best_move_reducer.get_value().first;
-	return best_diff.get_value() * mul;	
+	p->move = m;
+	p->done = true;
+}
+
+void HumanTurn(Board *b, int color);
+
+/*
+	the human's turn against a computer. the pondering search is spawned and the human's
+	move is read in the continuation, which another worker steals, so it takes at least two
+	workers. the table is kept for the computer's turn, which reuses it when the guess was
+	right.
+*/
+void HumanTurnPondering(Board *b, int color, Player *computer)
+{
+	ull P = b->disks[color], O = b->disks[OTHERCOLOR(color)];
+	int empties = 64 - PopCount(P | O);
+	pondering.hit = false;
+	/* the solver cannot be aborted, so positions it would solve are not pondered */
+	if(__cilkrts_get_nworkers() < 2 || !GetMoves(P, O) || (endgame_empties > 0 && empties - 1 <= endgame_empties)) {
+		HumanTurn(b, color);
+		return;
+	}
+
+	pondering.board = *b;
+	Move guess = SquareToMove(PredictMove(P, O));
+	FlipDisks(guess, &pondering.board, color, 0, 1);
+	PlaceOrFlip(guess, &pondering.board, color);
+	pondering.color = computer->color;
+	pondering.depth = computer->depth;
+	pondering.done = false;
+
+	TTNewSearch();
+	search_abort = false;
+	cilk_spawn PonderSearch(&pondering);
+	HumanTurn(b, color);
+	search_abort = true;
+	cilk_sync;
+	search_abort = false;
+
+	pondering.hit = b->disks[X_BLACK] == pondering.board.disks[X_BLACK] && b->disks[O_WHITE] == pondering.board.disks[O_WHITE];
+	if(pondering.hit) ponder_hits++;
+	else ponder_misses++;
 }
 
 void ComputerTurn(Board *b, Player *player)
@@ -409,7 +556,52 @@ void ComputerTurn(Board *b, Player *player)
 	/* start case when best move is unknown or not possible */
 	Move best_move = {-1,-1};
 
-	int best_diff= findBestMove(*b, color, 1, player->depth, 1, true, best_move);
+	/* the table already holds the search of this position when pondering guessed right */
+	bool reuse = pondering.hit;
+	pondering.hit = false;
+
+	/* close enough to the end of the game, search it exactly instead of to the given depth */
+	int empties = 64 - CountBitsOnBoard(*b, X_BLACK) - CountBitsOnBoard(*b, O_WHITE);
+	int best_sq, score;
+	/* book moves are played as they are, except in analysis where every move gets scored */
+	if(multipv_lines == 0 && BookProbe(b->disks[color], b->disks[OTHERCOLOR(color)], &best_sq, &score)) {
+		best_move = SquareToMove(best_sq);
+		if(VERBOSE) printf("Book move for Player %d, score %d\n", color + 1, score);
+	}
+	else if(player->type == MCTS) {
+		MCTSSearch(b->disks[color], b->disks[OTHERCOLOR(color)], player->millis, &best_sq);
+		if(best_sq >= 0) best_move = SquareToMove(best_sq);
+	}
+	else if(endgame_empties > 0 && empties <= endgame_empties) {
+		SolveEndgameRoot(b->disks[color], b->disks[OTHERCOLOR(color)], &best_sq);
+		if(best_sq >= 0) best_move = SquareToMove(best_sq);
+	}
+	else if(multipv_lines > 0) {
+		/* the table keeps what the previous searches of the game found, aged by the new date */
+		if(!reuse) TTNewSearch();
+		RootMove moves[MAX_MOVES];
+		int n = MultiPVSearch(b->disks[color], b->disks[OTHERCOLOR(color)], player->depth, moves);
+		PrintMultiPV(color, player->depth, moves, n);
+		if(n > 0) best_move = SquareToMove(moves[0].sq);
+	}
+	else if(node_budget > 0) {
+		TTNewSearch();
+		int depth;
+		BudgetSearch(b->disks[color], b->disks[OTHERCOLOR(color)], player->depth, node_budget, &best_sq, &depth);
+		if(best_sq >= 0) {
+			best_move = SquareToMove(best_sq);
+			budget_moves++;
+			budget_depth_sum += depth;
+		}
+	}
+	else if(reuse && pondering.done) {
+		best_move = pondering.move;
+	}
+	else {
+		/* the table keeps what the previous searches of the game found, aged by the new date */
+		if(!reuse) TTNewSearch();
+		findBestMove(*b, color, player->depth, best_move);
+	}
 
 	/* if the best move is not possible then skip turn else print it*/
 	if(isStartMove(best_move)){
@@ -432,18 +624,27 @@ void ComputerTurn(Board *b, Player *player)
 
 /* evaluate the inputs given to the program
 		- The search depth should be within range (1-60)
-		- The player types should be either h or c
+		- The player types should be either h, c or m
+		- The thinking time of an MCTS player should be positive
 */
 bool EvaluateInputs(Player p1, Player p2){
 	bool result = true;
-	if(p1.type != COMPUTER and p1.type != HUMAN){
-		cout<<"p1 player type is incorrect. Enter c for computer, h for human \n";
+	if(p1.type != COMPUTER and p1.type != HUMAN and p1.type != MCTS){
+		cout<<"p1 player type is incorrect. Enter c for computer, m for MCTS, h for human \n";
 		result  = false;
 	}
-	if(p2.type != COMPUTER and p2.type != HUMAN){
+	if(p2.type != COMPUTER and p2.type != HUMAN and p2.type != MCTS){
 		cout<<"p2 player type is incorrect \n";
 		result = false;
 	}
+	if(p1.type == MCTS and p1.millis < 1){
+		cout<<"thinking time for MCTS player 1 should be at least 1 ms \n";
+		result = false;
+	}
+	if(p2.type == MCTS and p2.millis < 1){
+		cout<<"thinking time for MCTS player 2 should be at least 1 ms \n";
+		result = false;
+	}
 	if(p1.depth > 60 or p1.depth < 1){
 		cout<<"search depth for computer 1 should be between 1-60 \n";
 		result = false;
@@ -457,9 +658,10 @@ bool EvaluateInputs(Player p1, Player p2){
 	return result;
 }
 
-void TakeTurn(Board *gameboard, Player *p){
+void TakeTurn(Board *gameboard, Player *p, Player *opponent){
 	
-	if(p->type == COMPUTER) ComputerTurn(gameboard, p);
+	if(p->type == COMPUTER or p->type == MCTS) ComputerTurn(gameboard, p);
+	else if(ponder && opponent->type == COMPUTER) HumanTurnPondering(gameboard, p->color, opponent);
 	else HumanTurn(gameboard, p->color);
 }
 
@@ -477,22 +679,710 @@ void EndGame(Board b)
 }
 
 
+/* prints the usage of the command line options */
+void Usage(const char *program)
+{
+	printf("usage: %s [options] [verbose]\n", program);
+	printf("       %s [options] probcut-fit npositions file [max_depth] [records]\n", program);
+	printf("       %s [options] bench [depth] [npositions]\n", program);
+	printf("       %s [options] perft [depth] [cache_mb]\n", program);
+	printf("       %s [options] mcts-bench [millis] [npositions]\n", program);
+	printf("       %s [options] playout-bench [nplayouts]\n", program);
+	printf("       %s [options] eval-bench [depth] [npositions]\n", program);
+	printf("       %s [options] eval-match mode [depth] [ngames]\n", program);
+	printf("       %s [options] book-build plies depth file [seconds]\n", program);
+	printf("       %s [options] dfpn empties [npositions] [mb]\n", program);
+	printf("       %s [options] selfplay ngames depth file [exact_empties] [random_plies]\n", program);
+	printf("       %s [options] pattern-train records weights [epochs] [rate]\n", program);
+	printf("  -e, --endgame=N      solve the game exactly once at most N squares are empty (default 0, off)\n");
+	printf("  -m, --probcut=FILE   read the Multi-ProbCut parameters from FILE\n");
+	printf("  -s, --selectivity=N  0 searches exactly, 1-%d use Multi-ProbCut, higher cuts more (default 0)\n", MAX_SELECTIVITY);
+	printf("  -H, --hash=MB        size of the transposition table (default %d)\n", tt_megabytes);
+	printf("  -E, --etc            probe the children in the table before searching them (ETC)\n");
+	printf("  -p, --parallel=MODE  cilk splits the tree (default), lazysmp runs one search per worker,\n");
+	printf("                       abdada too but defers the moves other workers are searching\n");
+	printf("  -P, --ponder         search the computer's reply to the expected move during the human's turn\n");
+	printf("  -T, --mcts=MODE      root grows one MCTS tree per worker (default), tree one shared tree\n");
+	printf("  -S, --single-playouts  play out each MCTS leaf once instead of %d times in a vector batch\n", PLAYOUT_LANES);
+	printf("  -n, --nodes=N        search each computer move to about N nodes, the depth becomes a maximum;\n");
+	printf("                       the moves are the same on every run with the same number of workers\n");
+	printf("  -M, --multipv=K      score every root move exactly and print the PVs of the best K\n");
+	printf("  -v, --eval=MODE      disc evaluates the disk difference (default), positional mobility, corners...,\n");
+	printf("                       pattern the pattern tables of --pattern-weights, nnue the network of --nnue-weights\n");
+	printf("  -w, --eval-weights=FILE  read the weights of the positional evaluation from FILE\n");
+	printf("  -W, --pattern-weights=FILE  map the binary pattern weights FILE\n");
+	printf("  -N, --nnue-weights=FILE  read the binary network weights FILE\n");
+	printf("  -b, --book=FILE      play the moves of the opening book FILE while the positions are in it\n");
+	printf("  -c, --eg-cache=FILE  keep the exact endgame results in FILE across runs, created if missing\n");
+	printf("  -C, --eg-cache-empties=N  cache the positions with %d-N empties (default %d)\n", EGC_MIN_EMPTIES, egcache_empties);
+}
+
+/* parses the command line options, leaving optind on the first non-option argument */
+bool ParseOptions(int argc, char * const argv[])
+{
+	static struct option long_options[] = {
+		{"endgame", required_argument, 0, 'e'},
+		{"probcut", required_argument, 0, 'm'},
+		{"selectivity", required_argument, 0, 's'},
+		{"hash", required_argument, 0, 'H'},
+		{"etc", no_argument, 0, 'E'},
+		{"parallel", required_argument, 0, 'p'},
+		{"multipv", required_argument, 0, 'M'},
+		{"ponder", no_argument, 0, 'P'},
+		{"nodes", required_argument, 0, 'n'},
+		{"mcts", required_argument, 0, 'T'},
+		{"single-playouts", no_argument, 0, 'S'},
+		{"eval", required_argument, 0, 'v'},
+		{"eval-weights", required_argument, 0, 'w'},
+		{"pattern-weights", required_argument, 0, 'W'},
+		{"nnue-weights", required_argument, 0, 'N'},
+		{"book", required_argument, 0, 'b'},
+		{"eg-cache", required_argument, 0, 'c'},
+		{"eg-cache-empties", required_argument, 0, 'C'},
+		{0, 0, 0, 0}
+	};
+	const char *probcut_file = NULL;
+	const char *book_file = NULL;
+	const char *eval_file = NULL;
+	const char *pattern_file = NULL;
+	const char *nnue_file = NULL;
+	const char *egcache_file = NULL;
+	int opt;
+	while((opt = getopt_long(argc, argv, "e:m:s:H:Ep:M:Pn:T:Sv:w:W:N:b:c:C:", long_options, NULL)) != -1) {
+		switch(opt) {
+		case 'e':
+			endgame_empties = atoi(optarg);
+			break;
+		case 'm':
+			probcut_file = optarg;
+			break;
+		case 's':
+			search_selectivity = atoi(optarg);
+			break;
+		case 'H':
+			tt_megabytes = atoi(optarg);
+			break;
+		case 'E':
+			search_etc = true;
+			break;
+		case 'p':
+			for(parallel_mode = 0; parallel_mode < NPARALLEL_MODES; parallel_mode++) {
+				if(!strcmp(optarg, parallel_names[parallel_mode])) break;
+			}
+			if(parallel_mode == NPARALLEL_MODES) {
+				printf("unknown parallel mode %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'M':
+			multipv_lines = atoi(optarg);
+			break;
+		case 'P':
+			ponder = true;
+			break;
+		case 'n':
+			node_budget = strtoull(optarg, NULL, 10);
+			break;
+		case 'T':
+			for(mcts_mode = 0; mcts_mode < NMCTS_MODES; mcts_mode++) {
+				if(!strcmp(optarg, mcts_names[mcts_mode])) break;
+			}
+			if(mcts_mode == NMCTS_MODES) {
+				printf("unknown MCTS mode %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'S':
+			mcts_batch = false;
+			break;
+		case 'v':
+			for(eval_mode = 0; eval_mode < NEVAL_MODES; eval_mode++) {
+				if(!strcmp(optarg, eval_names[eval_mode])) break;
+			}
+			if(eval_mode == NEVAL_MODES) {
+				printf("unknown evaluation %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'w':
+			eval_file = optarg;
+			break;
+		case 'W':
+			pattern_file = optarg;
+			break;
+		case 'N':
+			nnue_file = optarg;
+			break;
+		case 'b':
+			book_file = optarg;
+			break;
+		case 'c':
+			egcache_file = optarg;
+			break;
+		case 'C':
+			egcache_empties = atoi(optarg);
+			break;
+		default:
+			Usage(argv[0]);
+			return false;
+		}
+	}
+	if(search_selectivity < 0 or search_selectivity > MAX_SELECTIVITY){
+		printf("selectivity should be between 0-%d\n", MAX_SELECTIVITY);
+		return false;
+	}
+	if(search_selectivity > 0 and !probcut_file){
+		printf("a selectivity above 0 needs the probcut parameters (--probcut=FILE)\n");
+		return false;
+	}
+	if(node_budget > 0 and (ponder or multipv_lines > 0)){
+		printf("a node budget cannot be combined with --ponder or --multipv, whose searches depend on timing\n");
+		return false;
+	}
+	if(probcut_file and !LoadProbCut(probcut_file)) return false;
+	if(eval_mode == EVAL_PATTERN and !pattern_file){
+		printf("the pattern evaluation needs its weights (--pattern-weights=FILE)\n");
+		return false;
+	}
+	if(eval_file and !LoadEvalWeights(eval_file)) return false;
+	if(eval_mode == EVAL_NNUE and !nnue_file){
+		printf("the network evaluation needs its weights (--nnue-weights=FILE)\n");
+		return false;
+	}
+	if(pattern_file and !PatternOpen(pattern_file)) return false;
+	if(nnue_file and !LoadNNUE(nnue_file)) return false;
+	if(book_file and !BookOpen(book_file)) return false;
+	if(egcache_file and !EGCacheOpen(egcache_file)) return false;
+	if(mcts_mode == MCTS_TREE and !MCTSInit()) return false;
+	return TTInit(tt_megabytes);
+}
+
+/*
+	plays random moves from the start position for the given number of plies.
+	returns false when the game ends before that.
+*/
+bool RandomPosition(unsigned int *seed, int plies, ull *P, ull *O)
+{
+	*P = start.disks[X_BLACK];
+	*O = start.disks[O_WHITE];
+	for(int ply = 0; ply < plies; ply++) {
+		ull moves = GetMoves(*P, *O);
+		if(!moves) {
+			if(!GetMoves(*O, *P)) return false;
+			swap(*P, *O);
+			continue;
+		}
+		for(int k = rand_r(seed) % PopCount(moves); k > 0; k--) moves &= moves - 1;
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, *P, *O);
+		ull mover = *P | flips | BB_SQUARE(sq);
+		*P = *O & ~flips;
+		*O = mover;
+	}
+	return GetMoves(*P, *O) != 0;
+}
+
+/*
+	fits the Multi-ProbCut parameters on random positions, or on positions of the self-play
+	records file when there is one: each position is searched exactly to every depth up to
+	max_depth, and for every depth pair used by the search the deep results are regressed
+	on the shallow ones per stage. the positions are searched in parallel, one position per
+	iteration.
+*/
+int ProbCutFit(int npositions, const char *path, int max_depth, const char *records)
+{
+	if(npositions < 1 or max_depth < MPC_MIN_DEPTH or max_depth > MPC_MAX_DEPTH) {
+		printf("probcut-fit needs a positive number of positions and a max depth between %d-%d\n",
+			MPC_MIN_DEPTH, MPC_MAX_DEPTH);
+		return 1;
+	}
+
+	vector<ull> positions(2 * npositions);
+	if(records) {
+		vector<SelfPlayRecord> sample;
+		if(!SelfPlaySample(records, npositions, &sample)) return 1;
+		for(int i = 0; i < npositions; i++) {
+			positions[2 * i] = sample[i].P;
+			positions[2 * i + 1] = sample[i].O;
+		}
+	}
+	unsigned int seed = 1;
+	for(int i = 0; !records and i < npositions; ) {
+		if(RandomPosition(&seed, rand_r(&seed) % 56, &positions[2 * i], &positions[2 * i + 1])) i++;
+	}
+
+	search_selectivity = 0;
+	vector<int> scores(npositions * (max_depth + 1));
+	timer_start();
+	cilk_for(int i = 0; i < npositions; i++) {
+		for(int depth = 1; depth <= max_depth; depth++) {
+			scores[i * (max_depth + 1) + depth] = AlphaBeta(positions[2 * i], positions[2 * i + 1], 
+				-SCORE_INF, SCORE_INF, depth, false);
+		}
+	}
+
+	/* shallow depths of the same parity as the deep one, around a quarter and a half of it */
+	static Regression fits[MPC_STAGES][MPC_MAX_DEPTH + 1][MPC_MAX_DEPTH + 1];
+	for(int i = 0; i < npositions; i++) {
+		int stage = ProbCutStage(positions[2 * i] | positions[2 * i + 1]);
+		int *v = &scores[i * (max_depth + 1)];
+		for(int depth = MPC_MIN_DEPTH; depth <= max_depth; depth++) {
+			for(int shallow = 1; shallow < depth; shallow++) {
+				if((depth - shallow) % 2 == 0) RegressionAdd(&fits[stage][depth][shallow], v[shallow], v[depth]);
+			}
+		}
+	}
+
+	for(int stage = 0; stage < MPC_STAGES; stage++) {
+		for(int depth = MPC_MIN_DEPTH; depth <= max_depth; depth++) {
+			int quarter = depth / 4 - (depth - depth / 4) % 2;
+			int half = depth / 2 - (depth - depth / 2) % 2;
+			nprobcut_pairs[stage][depth] = 0;
+			for(int shallow = quarter; shallow <= half; shallow += half - quarter) {
+				ProbCutPair pair;
+				pair.shallow = shallow;
+				if(shallow >= 1 and RegressionFit(&fits[stage][depth][shallow], &pair)) {
+					probcut_pairs[stage][depth][nprobcut_pairs[stage][depth]++] = pair;
+				}
+				if(half == quarter) break;
+			}
+		}
+	}
+
+	printf("Fitted %d positions to depth %d in %g seconds\n", npositions, max_depth, timer_elapsed());
+	return SaveProbCut(path) ? 0 : 1;
+}
+
+/*
+	searches the same random positions with every parallel mode on the current number of
+	workers and prints one line per mode, so that runs over CILK_NWORKERS=1..32 (bench.sbatch)
+	compare the modes head to head.
+*/
+vector<Board> BenchPositions(int npositions)
+{
+	vector<Board> positions(npositions);
+	unsigned int seed = 1;
+	for(int i = 0; i < npositions; ) {
+		Board b;
+		if(RandomPosition(&seed, 10 + rand_r(&seed) % 30, &b.disks[X_BLACK], &b.disks[O_WHITE])) positions[i++] = b;
+	}
+	return positions;
+}
+
+int Bench(int depth, int npositions)
+{
+	vector<Board> positions = BenchPositions(npositions);
+
+	int mode = parallel_mode;
+	for(parallel_mode = 0; parallel_mode < NPARALLEL_MODES; parallel_mode++) {
+		/* no mode may find the positions in the table from the previous one */
+		TTClear();
+		int score_sum = 0;
+		CounterReset(&search_nodes);
+		timer_start();
+		for(int i = 0; i < npositions; i++) {
+			Move m;
+			TTNewSearch();
+			score_sum += findBestMove(positions[i], X_BLACK, depth, m);
+		}
+		double elapsed = timer_elapsed();
+		ull nodes = CounterTotal(&search_nodes);
+		printf("bench mode=%s workers=%d depth=%d positions=%d time=%.3f nodes=%llu nps=%.0f score_sum=%d\n",
+			parallel_names[parallel_mode], __cilkrts_get_nworkers(), depth, npositions, elapsed, nodes,
+			nodes / elapsed, score_sum);
+	}
+	parallel_mode = mode;
+	return 0;
+}
+
+/*
+	compares the scalar and the AVX2 code of the pattern or network evaluation: the cilk
+	search of the bench positions with each, and the evaluations per second of the
+	positions alone. the checksum of the evaluations is the same for both codes when they
+	agree.
+*/
+int EvalBench(int depth, int npositions)
+{
+	if(!EvalIncremental()) {
+		printf("eval-bench compares the codes of the pattern and network evaluations, run it with --eval=pattern or nnue\n");
+		return 1;
+	}
+	vector<Board> positions = BenchPositions(npositions);
+	vector<EvalState> states(npositions);
+	for(int i = 0; i < npositions; i++) EvalSetState(positions[i].disks[X_BLACK], positions[i].disks[O_WHITE], &states[i]);
+
+	const char *names[2] = { "scalar", "avx2" };
+	bool avx2 = __builtin_cpu_supports("avx2");
+	double nps[2], eps[2];
+	int pattern_code = pattern_avx2, nnue_code = nnue_avx2;
+	for(int code = 0; code < 2; code++) {
+		if(code == 1 and !avx2) {
+			printf("eval-bench code=%s not supported by this CPU\n", names[code]);
+			continue;
+		}
+		pattern_avx2 = nnue_avx2 = code;
+		TTClear();
+		int score_sum = 0;
+		CounterReset(&search_nodes);
+		timer_start();
+		for(int i = 0; i < npositions; i++) {
+			Move m;
+			TTNewSearch();
+			score_sum += findBestMove(positions[i], X_BLACK, depth, m);
+		}
+		double elapsed = timer_elapsed();
+		ull nodes = CounterTotal(&search_nodes);
+		nps[code] = nodes / elapsed;
+
+		const ull nevals = 10000000;
+		long long checksum = 0;
+		timer_start();
+		for(ull n = 0; n < nevals; n++) {
+			const Board &b = positions[n % npositions];
+			checksum += EvaluateState(&states[n % npositions], b.disks[X_BLACK], b.disks[O_WHITE]);
+		}
+		double eval_elapsed = timer_elapsed();
+		eps[code] = nevals / eval_elapsed;
+		printf("eval-bench eval=%s code=%s workers=%d depth=%d positions=%d time=%.3f nodes=%llu nps=%.0f score_sum=%d evals_per_second=%.0f checksum=%lld\n",
+			eval_names[eval_mode], names[code], __cilkrts_get_nworkers(), depth, npositions, elapsed, nodes, nps[code], score_sum, eps[code],
+			checksum);
+	}
+	pattern_avx2 = pattern_code;
+	nnue_avx2 = nnue_code;
+	if(avx2) printf("eval-bench avx2 gain nps=%.2fx evals=%.2fx\n", nps[1] / nps[0], eps[1] / eps[0]);
+	return 0;
+}
+
+/* random plies played before a match game, one opening for each pair of games */
+#define EVAL_MATCH_PLIES 8
+
+/*
+	plays games between the --eval evaluation and another one, both searching to depth in
+	the current parallel mode. every opening is played twice, each evaluation taking black
+	once; the table is cleared before each move since the scores of the two do not mix.
+	prints the result of the --eval side and the nodes per second of each.
+*/
+int EvalMatch(const char *other_name, int depth, int ngames)
+{
+	int modes[2] = { eval_mode, -1 };
+	for(int i = 0; i < NEVAL_MODES; i++) if(!strcmp(other_name, eval_names[i])) modes[1] = i;
+	if(modes[1] < 0 or depth < 1 or ngames < 1) {
+		printf("eval-match needs an evaluation mode, a positive depth and number of games\n");
+		return 1;
+	}
+	for(int side = 0; side < 2; side++) {
+		if((modes[side] == EVAL_PATTERN and !pattern.weights) or (modes[side] == EVAL_NNUE and !nnue_loaded)) {
+			printf("eval-match needs the weights of the %s evaluation\n", eval_names[modes[side]]);
+			return 1;
+		}
+	}
+
+	unsigned int seed = 1;
+	int wins = 0, draws = 0, losses = 0, disk_sum = 0;
+	ull nodes[2] = { 0, 0 };
+	double elapsed[2] = { 0, 0 };
+	ull opening_P = 0, opening_O = 0;
+	for(int game = 0; game < ngames; game++) {
+		if(game % 2 == 0) while(!RandomPosition(&seed, EVAL_MATCH_PLIES, &opening_P, &opening_O));
+		/* black moves first after an even number of plies, the --eval side is black in even games */
+		ull P = opening_P, O = opening_O;
+		int side = (game + EVAL_MATCH_PLIES) % 2;
+		for(;;) {
+			if(!GetMoves(P, O)) {
+				if(!GetMoves(O, P)) break;
+				swap(P, O);
+				side = 1 - side;
+				continue;
+			}
+			eval_mode = modes[side];
+			TTClear();
+			TTNewSearch();
+			CounterReset(&search_nodes);
+			Board b;
+			b.disks[X_BLACK] = P;
+			b.disks[O_WHITE] = O;
+			Move m;
+			timer_start();
+			findBestMove(b, X_BLACK, depth, m);
+			elapsed[side] += timer_elapsed();
+			nodes[side] += CounterTotal(&search_nodes);
+
+			int sq = BOARD_BIT_INDEX(m.row, m.col);
+			ull flips = GetFlips(sq, P, O);
+			ull mover = P | flips | BB_SQUARE(sq);
+			P = O & ~flips;
+			O = mover;
+			side = 1 - side;
+		}
+		int diff = side == 0 ? PopCount(P) - PopCount(O) : PopCount(O) - PopCount(P);
+		disk_sum += diff;
+		if(diff > 0) wins++;
+		else if(diff == 0) draws++;
+		else losses++;
+	}
+	eval_mode = modes[0];
+	printf("eval-match eval=%s other=%s depth=%d games=%d wins=%d draws=%d losses=%d disk_sum=%d nps=%.0f other_nps=%.0f\n",
+		eval_names[modes[0]], eval_names[modes[1]], depth, ngames, wins, draws, losses, disk_sum,
+		nodes[0] / elapsed[0], nodes[1] / elapsed[1]);
+	return 0;
+}
+
+/*
+	counts the positions reachable from the start board at every depth up to max_depth,
+	through a cache of cache_mb MB when it is not 0. the cache is kept from one depth to the
+	next, so the deeper counts reuse the shallower subtrees.
+*/
+int PerftMode(int max_depth, ull cache_mb)
+{
+	if(max_depth < 1 or max_depth > 60) {
+		printf("perft depth should be between 1-60\n");
+		return 1;
+	}
+	if(!PerftCacheInit(cache_mb)) return 1;
+	for(int depth = 1; depth <= max_depth; depth++) {
+		CounterReset(&perft_probes);
+		CounterReset(&perft_hits);
+		timer_start();
+		ull count = PerftCached(start.disks[X_BLACK], start.disks[O_WHITE], depth, false);
+		double elapsed = timer_elapsed();
+		printf("perft workers=%d depth=%d count=%llu time=%.3f nps=%.0f", __cilkrts_get_nworkers(), depth, count,
+			elapsed, elapsed > 0 ? count / elapsed : 0.0);
+		if(cache_mb) printf(" probes=%llu hits=%llu", CounterTotal(&perft_probes), CounterTotal(&perft_hits));
+		printf("\n");
+	}
+	return 0;
+}
+
+/*
+	proves the result of random positions with the given number of empties with df-pn in
+	at most mb MB of tables: a win when the side to move gets at least +1, else a draw when
+	it gets at least 0, else a loss.
+*/
+int DfpnMode(int empties, int npositions, ull mb)
+{
+	if(empties < 1 or empties > 59 or npositions < 1) {
+		printf("dfpn needs between 1-59 empties and a positive number of positions\n");
+		return 1;
+	}
+	if(!DfpnInit(mb)) return 1;
+	unsigned int seed = 1;
+	for(int i = 0; i < npositions; ) {
+		ull P, O;
+		if(!RandomPosition(&seed, 60 - empties, &P, &O) or 64 - PopCount(P | O) != empties) continue;
+		i++;
+		CounterReset(&dfpn_nodes);
+		timer_start();
+		int best_sq;
+		const char *result = "win";
+		if(!DfpnRoot(P, O, 1, &best_sq)) result = DfpnRoot(P, O, 0, &best_sq) ? "draw" : "loss";
+		double elapsed = timer_elapsed();
+		ull nodes = CounterTotal(&dfpn_nodes);
+		printf("dfpn workers=%d position=%d empties=%d result=%s move=%d,%d nodes=%llu time=%.3f nps=%.0f\n",
+			__cilkrts_get_nworkers(), i, empties, result, best_sq < 0 ? 0 : SQUARE_ROW(best_sq),
+			best_sq < 0 ? 0 : SQUARE_COL(best_sq), nodes, elapsed, elapsed > 0 ? nodes / elapsed : 0.0);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/*
+	runs the MCTS player on the same random positions in every MCTS mode on the current
+	number of workers and prints the playouts per second of each, see Bench.
+*/
+int MCTSBench(int millis, int npositions)
+{
+	vector<Board> positions(npositions);
+	unsigned int seed = 1;
+	for(int i = 0; i < npositions; ) {
+		Board b;
+		if(RandomPosition(&seed, 10 + rand_r(&seed) % 30, &b.disks[X_BLACK], &b.disks[O_WHITE])) positions[i++] = b;
+	}
+
+	int mode = mcts_mode;
+	for(mcts_mode = 0; mcts_mode < NMCTS_MODES; mcts_mode++) {
+		if(mcts_mode == MCTS_TREE and !MCTSInit()) return 1;
+		ull playouts = 0;
+		timer_start();
+		for(int i = 0; i < npositions; i++) {
+			int best_sq;
+			playouts += MCTSSearch(positions[i].disks[X_BLACK], positions[i].disks[O_WHITE], millis, &best_sq);
+		}
+		double elapsed = timer_elapsed();
+		printf("mcts-bench mode=%s workers=%d millis=%d positions=%d time=%.3f playouts=%llu pps=%.0f\n",
+			mcts_names[mcts_mode], __cilkrts_get_nworkers(), millis, npositions, elapsed, playouts, playouts / elapsed);
+	}
+	mcts_mode = mode;
+	return 0;
+}
+
+/*
+	plays random games from the start position on one core, one at a time and in batches
+	with each playout code, and prints the playouts per second and the average score of
+	each: the two batch codes play the same games, so their averages are equal, while the
+	single playouts draw other games and agree with them only statistically.
+*/
+int PlayoutBench(ull nplayouts)
+{
+	const char *names[3] = { "single", "batch-scalar", "batch-avx2" };
+	ull P[PLAYOUT_LANES], O[PLAYOUT_LANES];
+	for(int i = 0; i < PLAYOUT_LANES; i++) {
+		P[i] = start.disks[X_BLACK];
+		O[i] = start.disks[O_WHITE];
+	}
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+
+	for(int code = 0; code < 3; code++) {
+		if(code == 2 and !avx2) {
+			printf("playout-bench code=%s not supported by this CPU\n", names[code]);
+			continue;
+		}
+		ull state = 0x9e3779b97f4a7c15ULL;
+		long long sum = 0;
+		int scores[PLAYOUT_LANES];
+		timer_start();
+		for(ull n = 0; n < nplayouts; ) {
+			if(code == 0) {
+				sum += RandomPlayout(P[0], O[0], &state);
+				n++;
+				continue;
+			}
+			if(code == 1) BatchPlayoutScalar(P, O, &state, scores);
+			else BatchPlayoutAVX2(P, O, &state, scores);
+			for(int i = 0; i < PLAYOUT_LANES; i++) sum += scores[i];
+			n += PLAYOUT_LANES;
+		}
+		double elapsed = timer_elapsed();
+		printf("playout-bench code=%s playouts=%llu time=%.3f pps=%.0f average=%.3f\n", names[code], nplayouts,
+			elapsed, nplayouts / elapsed, (double) sum / nplayouts);
+	}
+	return 0;
+}
+
+/* prints the search counters that were used during the game */
+void PrintSearchStats()
+{
+	ull nodes = CounterTotal(&search_nodes);
+	if(nodes) {
+		printf("Search nodes: %llu probcut probes: %llu probcut cutoffs: %llu\n", nodes,
+			CounterTotal(&probcut_probes), CounterTotal(&probcut_cutoffs));
+	}
+	if(parallel_mode == PARALLEL_ABDADA) {
+		printf("ABDADA deferred moves: %llu\n", CounterTotal(&abdada_deferred));
+	}
+	ull playouts = CounterTotal(&mcts_playouts);
+	if(playouts) {
+		printf("MCTS playouts: %llu\n", playouts);
+	}
+	if(CounterTotal(&book_probes)) {
+		printf("Book probes: %llu book moves: %llu\n", CounterTotal(&book_probes), CounterTotal(&book_hits));
+	}
+	if(budget_moves) {
+		printf("Node budget moves: %d average depth: %.2f\n", budget_moves, (double) budget_depth_sum / budget_moves);
+	}
+	if(ponder) {
+		printf("Ponder hits: %d misses: %d\n", ponder_hits, ponder_misses);
+	}
+	if(search_etc) {
+		printf("ETC probes: %llu ETC cutoffs: %llu\n", CounterTotal(&etc_probes), CounterTotal(&etc_cutoffs));
+	}
+	nodes = CounterTotal(&endgame_nodes);
+	if(nodes) {
+		printf("Endgame nodes: %llu stability probes: %llu stability cutoffs: %llu\n", nodes,
+			CounterTotal(&stability_probes), CounterTotal(&stability_cutoffs));
+	}
+	if(egcache.entries) {
+		printf("Endgame cache probes: %llu hits: %llu stores: %llu\n", CounterTotal(&egcache_probes),
+			CounterTotal(&egcache_hits), CounterTotal(&egcache_stores));
+	}
+}
+
 /*	1. Ask for inputs
 		2. Evaluate them
 		3. Make the players play their move else skip
 		4. End the game if no legal move exists for both players and print final result
 		5. print the time for the game execution along with number of workers. 
 */
-int main (int argc, const char * argv[]) 
+int main (int argc, char * argv[]) 
 {
 
-	if ((argc >=2)) VERBOSE = atoi(argv[1]);
+	InitEval();
+	if (!ParseOptions(argc, argv)) return 1;
+
+	InitStability();
+
+	if (optind < argc && !strcmp(argv[optind], "probcut-fit")) {
+		if (argc - optind < 3) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return ProbCutFit(atoi(argv[optind + 1]), argv[optind + 2], argc - optind > 3 ? atoi(argv[optind + 3]) : 10,
+			argc - optind > 4 ? argv[optind + 4] : NULL);
+	}
+	if (optind < argc && !strcmp(argv[optind], "bench")) {
+		return Bench(argc - optind > 1 ? atoi(argv[optind + 1]) : 8, argc - optind > 2 ? atoi(argv[optind + 2]) : 20);
+	}
+	if (optind < argc && !strcmp(argv[optind], "perft")) {
+		return PerftMode(argc - optind > 1 ? atoi(argv[optind + 1]) : 9, argc - optind > 2 ? strtoull(argv[optind + 2], NULL, 10) : 0);
+	}
+	if (optind < argc && !strcmp(argv[optind], "mcts-bench")) {
+		return MCTSBench(argc - optind > 1 ? atoi(argv[optind + 1]) : 1000, argc - optind > 2 ? atoi(argv[optind + 2]) : 10);
+	}
+	if (optind < argc && !strcmp(argv[optind], "book-build")) {
+		if (argc - optind < 4 || atoi(argv[optind + 1]) < 1 || atoi(argv[optind + 2]) < 1) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return BookBuild(start.disks[X_BLACK], start.disks[O_WHITE], atoi(argv[optind + 1]), atoi(argv[optind + 2]),
+			argv[optind + 3], argc - optind > 4 ? atof(argv[optind + 4]) : 0);
+	}
+	if (optind < argc && !strcmp(argv[optind], "dfpn")) {
+		if (argc - optind < 2) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return DfpnMode(atoi(argv[optind + 1]), argc - optind > 2 ? atoi(argv[optind + 2]) : 1,
+			argc - optind > 3 ? strtoull(argv[optind + 3], NULL, 10) : 256);
+	}
+	if (optind < argc && !strcmp(argv[optind], "selfplay")) {
+		/* from 60 random plies on an opening never leaves a position to search */
+		int random_plies = argc - optind > 5 ? atoi(argv[optind + 5]) : 10;
+		if (argc - optind < 4 || atoi(argv[optind + 1]) < 1 || atoi(argv[optind + 2]) < 1 || atoi(argv[optind + 2]) >= SELFPLAY_EXACT_DEPTH
+			|| random_plies < 0 || random_plies > 59) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return SelfPlay(start.disks[X_BLACK], start.disks[O_WHITE], atoi(argv[optind + 1]), atoi(argv[optind + 2]),
+			argc - optind > 4 ? atoi(argv[optind + 4]) : 14, random_plies, argv[optind + 3]);
+	}
+	if (optind < argc && !strcmp(argv[optind], "pattern-train")) {
+		if (argc - optind < 3) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return PatternTrain(argv[optind + 1], argv[optind + 2], argc - optind > 3 ? atoi(argv[optind + 3]) : 10,
+			argc - optind > 4 ? atof(argv[optind + 4]) : 0.01);
+	}
+	if (optind < argc && !strcmp(argv[optind], "eval-bench")) {
+		return EvalBench(argc - optind > 1 ? atoi(argv[optind + 1]) : 8, argc - optind > 2 ? atoi(argv[optind + 2]) : 20);
+	}
+	if (optind < argc && !strcmp(argv[optind], "eval-match")) {
+		if (argc - optind < 2) {
+			Usage(argv[0]);
+			return 1;
+		}
+		return EvalMatch(argv[optind + 1], argc - optind > 2 ? atoi(argv[optind + 2]) : 4,
+			argc - optind > 3 ? atoi(argv[optind + 3]) : 40);
+	}
+	if (optind < argc && !strcmp(argv[optind], "playout-bench")) {
+		return PlayoutBench(argc - optind > 1 ? strtoull(argv[optind + 1], NULL, 10) : 1000000);
+	}
+	if (optind < argc) VERBOSE = atoi(argv[optind]);
 
 	Board gameboard = start;
 
-	cout<<"Enter c for computer, h for human \n";
+	cout<<"Enter c for computer, m for MCTS, h for human \n";
 	
-	Player p1 = {'h', X_BLACK, true, 1}, p2 = {'h', O_WHITE, true, 1};
+	Player p1 = {'h', X_BLACK, true, 1, 0}, p2 = {'h', O_WHITE, true, 1, 0};
 	
 	cout<<"Player 1: ";
 	cin>>p1.type;
@@ -500,6 +1390,10 @@ int main (int argc, const char * argv[])
 		cout<<"Enter search depth for the computer 1: (At max 60): ";
 		cin>>p1.depth;
 	}
+	if(p1.type == MCTS){
+		cout<<"Enter thinking time per move in ms for the MCTS player 1: ";
+		cin>>p1.millis;
+	}
 
 	cout<<"Player 2: ";	
 	cin>>p2.type;	
@@ -507,6 +1401,10 @@ int main (int argc, const char * argv[])
 		cout<<"Enter search depth for the computer 2: (At max 60): ";
 		cin>>p2.depth;
 	}
+	if(p2.type == MCTS){
+		cout<<"Enter thinking time per move in ms for the MCTS player 2: ";
+		cin>>p2.millis;
+	}
 	
 	if(!EvaluateInputs(p1,p2)){
 		return 0;
@@ -517,14 +1415,15 @@ int main (int argc, const char * argv[])
 	timer_start();
 	
 	do {
-		TakeTurn(&gameboard, &p1);
+		TakeTurn(&gameboard, &p1, &p2);
 		
-		TakeTurn(&gameboard, &p2);
+		TakeTurn(&gameboard, &p2, &p1);
 
 	} while(p1.move_possible | p2.move_possible);
 	
 	execution_time += timer_elapsed();
 	EndGame(gameboard);
+	PrintSearchStats();
 	
 	cout<<"Time taken: "<<execution_time<<" with workers: "<<__cilkrts_get_nworkers()<<endl;
 	
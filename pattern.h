@@ -0,0 +1,309 @@
+/*
+	pattern evaluation (--eval=pattern), in the style of Logistello and Edax.
+
+	A pattern is a set of squares; its configuration, each square empty, of the side to
+	move or of its opponent, is read as a base 3 number (empty 0, side to move 1, opponent
+	2, the first square the most significant digit) that indexes a table of weights. The
+	evaluation is the sum of the weights of every pattern on the board. The patterns are
+	given once in one orientation and placed on the board in all their distinct symmetric
+	images, which share the table of their pattern:
+	- edge + 2X: an edge and the two X squares next to it, 4 images
+	- corner 3x3 and corner 2x5: the squares of a corner, 4 and 8 images
+	- rows 2, 3 and 4 from an edge, 4 images each
+	- the diagonals of 8 to 4 squares, 2 images for the main diagonals and 4 for the others
+	which makes PATTERN_INSTANCES patterns on every board. There is one set of tables per
+	stage of the game, PATTERN_STAGES stages of 4 empties, each ending with a bias weight.
+
+	The search does not read the indexes off the bitboards at every leaf: the serial search
+	keeps them in a PatternIndexes that each move updates from its parent's, only for the
+	patterns of the squares played and flipped, through a map from every square to the
+	patterns it is in and its power of 3 there. The indexes are kept both for the side to
+	move and for its opponent so that a move, which swaps the sides, only adds to them.
+
+	The sum over the tables is then a gather: with AVX2 at run time, 8 patterns at a time
+	have their indexes widened to 32 bits and added to the start of their table, the
+	weights read by one vector gather and summed in a register. Without AVX2 it is the
+	scalar loop, which is also the reference the vector code is checked against.
+
+	The weights are fitted offline and read from a binary file mapped read only, used in
+	place without copying:
+
+		char magic[8] = "OTHPAT01"; ull nstages; ull nweights;
+		short weights[nstages][nweights];
+
+	in the byte order of the machine, nweights being PATTERN_WEIGHTS, the sizes of the
+	tables of the patterns in the order above and the bias. A weight is in 1/PATTERN_SCALE
+	disks; the evaluation is rounded to disks and kept within the score range of the search.
+*/
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <immintrin.h>
+#include "bitboard.h"
+
+#define PATTERN_MAGIC "OTHPAT01"
+
+#define PATTERN_TYPES 11
+#define PATTERN_MAX_SQUARES 10
+#define PATTERN_INSTANCES 46
+
+/* the indexes are kept in groups of 8 for the vector code, the 2 slots after the last unused */
+#define PATTERN_INDEX_SLOTS 48
+
+/* 4 empties per stage */
+#define PATTERN_STAGES 15
+
+#define PATTERN_SCALE 128
+
+/* the squares of each pattern in one orientation, as (row, col) with row 1 col 1 the top left */
+typedef struct { const char *name; int nsquares; int squares[PATTERN_MAX_SQUARES][2]; } PatternType;
+
+static const PatternType pattern_types[PATTERN_TYPES] = {
+	{ "edge+2x", 10, { {1,1}, {1,2}, {1,3}, {1,4}, {1,5}, {1,6}, {1,7}, {1,8}, {2,2}, {2,7} } },
+	{ "corner3x3", 9, { {1,1}, {1,2}, {1,3}, {2,1}, {2,2}, {2,3}, {3,1}, {3,2}, {3,3} } },
+	{ "corner2x5", 10, { {1,1}, {1,2}, {1,3}, {1,4}, {1,5}, {2,1}, {2,2}, {2,3}, {2,4}, {2,5} } },
+	{ "row2", 8, { {2,1}, {2,2}, {2,3}, {2,4}, {2,5}, {2,6}, {2,7}, {2,8} } },
+	{ "row3", 8, { {3,1}, {3,2}, {3,3}, {3,4}, {3,5}, {3,6}, {3,7}, {3,8} } },
+	{ "row4", 8, { {4,1}, {4,2}, {4,3}, {4,4}, {4,5}, {4,6}, {4,7}, {4,8} } },
+	{ "diag8", 8, { {1,1}, {2,2}, {3,3}, {4,4}, {5,5}, {6,6}, {7,7}, {8,8} } },
+	{ "diag7", 7, { {1,2}, {2,3}, {3,4}, {4,5}, {5,6}, {6,7}, {7,8} } },
+	{ "diag6", 6, { {1,3}, {2,4}, {3,5}, {4,6}, {5,7}, {6,8} } },
+	{ "diag5", 5, { {1,4}, {2,5}, {3,6}, {4,7}, {5,8} } },
+	{ "diag4", 4, { {1,5}, {2,6}, {3,7}, {4,8} } },
+};
+
+/* a pattern placed on the board: its type and its squares as bit indexes, in order */
+typedef struct { int type; int nsquares; int squares[PATTERN_MAX_SQUARES]; } PatternInstance;
+
+PatternInstance pattern_instances[PATTERN_INSTANCES];
+
+/* a square is in at most this many patterns */
+#define PATTERN_MAX_PER_SQUARE 8
+
+/* the patterns each square is in, with its power of 3 in their index */
+typedef struct { short instance; short power; } PatternSquare;
+
+PatternSquare pattern_squares[64][PATTERN_MAX_PER_SQUARE];
+int pattern_nsquares[64];
+
+/* the indexes of every pattern, [0] for the side to move and [1] for its opponent */
+typedef struct { unsigned short index[2][PATTERN_INDEX_SLOTS]; } PatternIndexes;
+
+/* weights of a stage: the tables of 3^nsquares weights of the types and the bias */
+#define PATTERN_WEIGHTS (2 * 59049 + 19683 + 4 * 6561 + 2187 + 729 + 243 + 81 + 1)
+
+/* where the table of each type, and of the type of each pattern, starts in the weights of a stage */
+int pattern_offset[PATTERN_TYPES];
+int pattern_base[PATTERN_INDEX_SLOTS];
+
+/* whether EvaluatePatternIndexes gathers with AVX2, decided once from the CPU by InitPatterns */
+int pattern_avx2 = 0;
+
+typedef struct { const short *weights; ull nstages; void *map; size_t size; } PatternWeights;
+
+PatternWeights pattern = { NULL, 0, NULL, 0 };
+
+typedef struct { char magic[8]; ull nstages; ull nweights; } PatternHeader;
+
+/* places every pattern in each of its distinct symmetric images */
+void InitPatterns()
+{
+	int n = 0, offset = 0;
+	memset(pattern_nsquares, 0, sizeof(pattern_nsquares));
+	memset(pattern_base, 0, sizeof(pattern_base));
+	pattern_avx2 = __builtin_cpu_supports("avx2");
+	for (int t = 0; t < PATTERN_TYPES; t++) {
+		const PatternType *type = &pattern_types[t];
+		ull placed[8];
+		int nplaced = 0;
+		for (int s = 0; s < 8; s++) {
+			PatternInstance instance;
+			instance.type = t;
+			instance.nsquares = type->nsquares;
+			ull set = 0;
+			for (int i = 0; i < type->nsquares; i++) {
+				ull b = Symmetry(BB_SQUARE((8 - type->squares[i][0]) * 8 + (8 - type->squares[i][1])), s);
+				instance.squares[i] = __builtin_ctzll(b);
+				set |= b;
+			}
+			/* an image on the same squares reads them in another order, it is the same pattern */
+			bool seen = false;
+			for (int i = 0; i < nplaced; i++) seen |= placed[i] == set;
+			if (seen) continue;
+			placed[nplaced++] = set;
+			int power = 1;
+			for (int i = type->nsquares - 1; i >= 0; i--, power *= 3) {
+				int sq = instance.squares[i];
+				pattern_squares[sq][pattern_nsquares[sq]].instance = n;
+				pattern_squares[sq][pattern_nsquares[sq]++].power = power;
+			}
+			pattern_base[n] = offset;
+			pattern_instances[n++] = instance;
+		}
+
+		pattern_offset[t] = offset;
+		int size = 1;
+		for (int i = 0; i < type->nsquares; i++) size *= 3;
+		offset += size;
+	}
+}
+
+void PatternClose()
+{
+	if (pattern.map) munmap(pattern.map, pattern.size);
+	pattern.weights = NULL;
+	pattern.nstages = 0;
+	pattern.map = NULL;
+	pattern.size = 0;
+}
+
+/* maps the weights file, checking its header against the patterns */
+bool PatternOpen(const char *path)
+{
+	PatternClose();
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("cannot open pattern weights %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(PatternHeader)) {
+		printf("pattern weights %s are too short\n", path);
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		printf("cannot map pattern weights %s\n", path);
+		return false;
+	}
+
+	const PatternHeader *header = (const PatternHeader *) map;
+	if (memcmp(header->magic, PATTERN_MAGIC, 8) != 0 || header->nstages != PATTERN_STAGES
+		|| header->nweights != (ull) PATTERN_WEIGHTS
+		|| sizeof(PatternHeader) + header->nstages * header->nweights * sizeof(short) != (ull) st.st_size) {
+		printf("%s are not pattern weights of %d stages of %d weights\n", path, PATTERN_STAGES, PATTERN_WEIGHTS);
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	pattern.map = map;
+	pattern.size = st.st_size;
+	pattern.weights = (const short *) (header + 1);
+	pattern.nstages = header->nstages;
+	return true;
+}
+
+static inline int PatternStage(ull P, ull O)
+{
+	int stage = (PopCount(P | O) - 4) / 4;
+	return stage < PATTERN_STAGES ? stage : PATTERN_STAGES - 1;
+}
+
+/* the base 3 index of the pattern for the side to move P */
+static inline int PatternIndex(const PatternInstance *instance, ull P, ull O)
+{
+	int index = 0;
+	for (int i = 0; i < instance->nsquares; i++) {
+		int sq = instance->squares[i];
+		index = index * 3 + (int) (P >> sq & 1) + 2 * (int) (O >> sq & 1);
+	}
+	return index;
+}
+
+static inline int PatternScore(int sum)
+{
+	int score = (sum + (sum < 0 ? -PATTERN_SCALE / 2 : PATTERN_SCALE / 2)) / PATTERN_SCALE;
+	return score < -64 ? -64 : score > 64 ? 64 : score;
+}
+
+void PatternSetIndexes(ull P, ull O, PatternIndexes *x)
+{
+	memset(x, 0, sizeof(*x));
+	for (int i = 0; i < PATTERN_INSTANCES; i++) {
+		x->index[0][i] = PatternIndex(&pattern_instances[i], P, O);
+		x->index[1][i] = PatternIndex(&pattern_instances[i], O, P);
+	}
+}
+
+/*
+	the indexes of the position after the side to move plays sq flipping flips, for the
+	opponent who moves next: the square played goes from empty (0) to 2 in the opponent's
+	view and to 1 in the mover's, a flipped disk from 1 to 2 and from 2 to 1.
+*/
+void PatternMove(const PatternIndexes *x, int sq, ull flips, PatternIndexes *child)
+{
+	memcpy(child->index[0], x->index[1], sizeof(child->index[0]));
+	memcpy(child->index[1], x->index[0], sizeof(child->index[1]));
+	for (int i = 0; i < pattern_nsquares[sq]; i++) {
+		const PatternSquare *s = &pattern_squares[sq][i];
+		child->index[0][s->instance] += 2 * s->power;
+		child->index[1][s->instance] += s->power;
+	}
+	for (; flips; flips &= flips - 1) {
+		int f = __builtin_ctzll(flips);
+		for (int i = 0; i < pattern_nsquares[f]; i++) {
+			const PatternSquare *s = &pattern_squares[f][i];
+			child->index[0][s->instance] += s->power;
+			child->index[1][s->instance] -= s->power;
+		}
+	}
+}
+
+/* the indexes after a pass, the sides swapped */
+void PatternPass(const PatternIndexes *x, PatternIndexes *child)
+{
+	memcpy(child->index[0], x->index[1], sizeof(child->index[0]));
+	memcpy(child->index[1], x->index[0], sizeof(child->index[1]));
+}
+
+/* the weights w of a stage summed over the patterns with the indexes index */
+int PatternSumScalar(const short *w, const unsigned short *index)
+{
+	int sum = 0;
+	for (int i = 0; i < PATTERN_INSTANCES; i++) sum += w[pattern_base[i] + index[i]];
+	return sum;
+}
+
+/*
+	gathers 32 bits at each weight, 2 bytes apart in the table, and keeps the low half sign
+	extended. the last weight read is followed by the bias, so no read goes past the tables.
+*/
+__attribute__((target("avx2")))
+int PatternSumAVX2(const short *w, const unsigned short *index)
+{
+	__m256i sum = _mm256_setzero_si256();
+	for (int i = 0; i < PATTERN_INDEX_SLOTS; i += 8) {
+		__m256i offsets = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (index + i))),
+			_mm256_loadu_si256((const __m256i *) (pattern_base + i)));
+		__m256i weights;
+		if (i + 8 <= PATTERN_INSTANCES) {
+			weights = _mm256_i32gather_epi32((const int *) w, offsets, 2);
+		} else {
+			__m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(PATTERN_INSTANCES - i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			weights = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *) w, offsets, mask, 2);
+		}
+		sum = _mm256_add_epi32(sum, _mm256_srai_epi32(_mm256_slli_epi32(weights, 16), 16));
+	}
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+
+/* the pattern evaluation of the position from its indexes, only a sum of table reads */
+int EvaluatePatternIndexes(const PatternIndexes *x, ull P, ull O)
+{
+	const short *w = pattern.weights + PatternStage(P, O) * PATTERN_WEIGHTS;
+	int sum = w[PATTERN_WEIGHTS - 1] + (pattern_avx2 ? PatternSumAVX2(w, x->index[0]) : PatternSumScalar(w, x->index[0]));
+	return PatternScore(sum);
+}
+
+#endif
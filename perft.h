@@ -0,0 +1,197 @@
+/*
+	perft: counts the positions reachable in a number of plies, a benchmark of the move
+	generation alone.
+
+	Passes are treated as the search treats them: a pass does not use up a ply, and a
+	position where neither side can move is a leaf whatever the depth left. The last ply is
+	not played out, its moves are just counted. Near the root the moves are counted in
+	parallel, each iteration writing its own slot of an array that is summed afterwards.
+
+	Deep counts go through a cache of (depth, position) -> count shared by the workers,
+	which counts every transposition once and every position once for all its symmetric
+	images: positions are looked up in their canonical form (CanonicalPosition), whose count
+	is the same since the moves are symmetric too. The cache is lockless like the
+	transposition table: an entry is the position, its count and a check word of a hash of
+	all three with the depth, so an entry torn by two concurrent stores fails the check.
+	It comes in buckets of two that fill one cache line; a store replaces the same position
+	or else the shallower entry.
+*/
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <cilk/cilk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "bitboard.h"
+#include "counter.h"
+#include "tt.h"
+
+/* below this depth perft no longer spawns */
+#define PERFT_SPLIT_DEPTH 5
+
+/* below this depth positions are counted without the cache */
+#define PERFT_CACHE_MIN_DEPTH 3
+
+/* the check word holds the depth in its low byte */
+typedef struct { std::atomic<ull> P, O, count, check; } PerftEntry;
+
+typedef struct { PerftEntry *entries; ull mask; } PerftCache;
+
+PerftCache perft_cache = { NULL, 0 };
+
+Counter perft_probes, perft_hits;
+
+ull Perft(ull P, ull O, int depth, bool passed)
+{
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return 1;
+		return Perft(O, P, depth, true);
+	}
+	if (depth == 1) return PopCount(moves);
+
+	ull count = 0;
+	for (; moves; moves &= moves - 1) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, P, O);
+		count += Perft(O & ~flips, P | flips | BB_SQUARE(sq), depth - 1, false);
+	}
+	return count;
+}
+
+ull PerftParallel(ull P, ull O, int depth, bool passed)
+{
+	if (depth < PERFT_SPLIT_DEPTH) return Perft(P, O, depth, passed);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return 1;
+		return PerftParallel(O, P, depth, true);
+	}
+
+	int squares[MAX_MOVES];
+	ull counts[MAX_MOVES];
+	int n = 0;
+	for (; moves; moves &= moves - 1) squares[n++] = __builtin_ctzll(moves);
+
+	cilk_for(int i = 0; i < n; i++) {
+		ull flips = GetFlips(squares[i], P, O);
+		counts[i] = PerftParallel(O & ~flips, P | flips | BB_SQUARE(squares[i]), depth - 1, false);
+	}
+
+	ull count = 0;
+	for (int i = 0; i < n; i++) count += counts[i];
+	return count;
+}
+
+/* rounds the size down to a power of two number of buckets, 0 frees the cache */
+bool PerftCacheInit(ull megabytes)
+{
+	free(perft_cache.entries);
+	perft_cache.entries = NULL;
+	perft_cache.mask = 0;
+	if (megabytes == 0) return true;
+
+	ull n = 2;
+	while (2 * n * sizeof(PerftEntry) <= megabytes << 20) n *= 2;
+	void *p;
+	if (posix_memalign(&p, 64, n * sizeof(PerftEntry))) {
+		printf("cannot allocate a %llu MB perft cache\n", megabytes);
+		return false;
+	}
+	memset(p, 0, n * sizeof(PerftEntry));
+	perft_cache.entries = (PerftEntry *) p;
+	perft_cache.mask = n - 1;
+	return true;
+}
+
+static inline ull PerftCheck(ull h, int depth, ull count)
+{
+	return ((h ^ count * 0x9e3779b97f4a7c15ULL) & ~0xffULL) | depth;
+}
+
+/* looks up the canonical position, returns true along with its count when it is cached */
+bool PerftProbe(ull P, ull O, ull h, int depth, ull *count)
+{
+	CounterAdd(&perft_probes, 1);
+	PerftEntry *bucket = &perft_cache.entries[h & perft_cache.mask & ~1ULL];
+	for (int i = 0; i < 2; i++) {
+		ull p = bucket[i].P.load(std::memory_order_relaxed);
+		ull o = bucket[i].O.load(std::memory_order_relaxed);
+		ull c = bucket[i].count.load(std::memory_order_relaxed);
+		ull check = bucket[i].check.load(std::memory_order_relaxed);
+		if (p == P && o == O && check == PerftCheck(h, depth, c)) {
+			CounterAdd(&perft_hits, 1);
+			*count = c;
+			return true;
+		}
+	}
+	return false;
+}
+
+void PerftStore(ull P, ull O, ull h, int depth, ull count)
+{
+	PerftEntry *bucket = &perft_cache.entries[h & perft_cache.mask & ~1ULL];
+	PerftEntry *replace = &bucket[0];
+	int replace_depth = 256;
+	for (int i = 0; i < 2; i++) {
+		int entry_depth = (int) (bucket[i].check.load(std::memory_order_relaxed) & 0xff);
+		if (bucket[i].P.load(std::memory_order_relaxed) == P && bucket[i].O.load(std::memory_order_relaxed) == O
+			&& entry_depth == depth) {
+			replace = &bucket[i];
+			break;
+		}
+		if (entry_depth < replace_depth) {
+			replace = &bucket[i];
+			replace_depth = entry_depth;
+		}
+	}
+	replace->P.store(P, std::memory_order_relaxed);
+	replace->O.store(O, std::memory_order_relaxed);
+	replace->count.store(count, std::memory_order_relaxed);
+	replace->check.store(PerftCheck(h, depth, count), std::memory_order_relaxed);
+}
+
+/* perft through the cache, spawning like PerftParallel */
+ull PerftCached(ull P, ull O, int depth, bool passed)
+{
+	if (depth < PERFT_CACHE_MIN_DEPTH || !perft_cache.entries) return PerftParallel(P, O, depth, passed);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return 1;
+		return PerftCached(O, P, depth, true);
+	}
+
+	ull canonical_P = P, canonical_O = O;
+	CanonicalPosition(&canonical_P, &canonical_O);
+	ull h = HashPosition(canonical_P, canonical_O);
+	ull count;
+	if (PerftProbe(canonical_P, canonical_O, h, depth, &count)) return count;
+
+	int squares[MAX_MOVES];
+	ull counts[MAX_MOVES];
+	int n = 0;
+	for (; moves; moves &= moves - 1) squares[n++] = __builtin_ctzll(moves);
+
+	if (depth >= PERFT_SPLIT_DEPTH) {
+		cilk_for(int i = 0; i < n; i++) {
+			ull flips = GetFlips(squares[i], P, O);
+			counts[i] = PerftCached(O & ~flips, P | flips | BB_SQUARE(squares[i]), depth - 1, false);
+		}
+	} else {
+		for (int i = 0; i < n; i++) {
+			ull flips = GetFlips(squares[i], P, O);
+			counts[i] = PerftCached(O & ~flips, P | flips | BB_SQUARE(squares[i]), depth - 1, false);
+		}
+	}
+
+	count = 0;
+	for (int i = 0; i < n; i++) count += counts[i];
+	PerftStore(canonical_P, canonical_O, h, depth, count);
+	return count;
+}
+
+#endif
@@ -0,0 +1,195 @@
+/*
+	random playouts for the MCTS player.
+
+	RandomPlayout plays one game to the end. BatchPlayout plays PLAYOUT_LANES games at once
+	in lockstep, one per 64 bit lane of an AVX2 register: the disks of the lanes are kept
+	side by side (struct of arrays), the moves and the flips of all lanes are computed by
+	the same vector instructions, and only the random choice of each lane's move is scalar
+	(a multiply picks the index, pdep the square). A lane whose game is over stops changing
+	while the others go on. Without AVX2 and BMI2 at run time the batch falls back to one
+	RandomPlayout per lane, which is also the reference the vector code is checked against:
+	each lane draws from its own random stream, seeded from the caller's at the start of
+	the batch, and picks its moves the way RandomSquare does, so both codes play the same
+	games and return the same scores.
+*/
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <immintrin.h>
+#include "bitboard.h"
+
+#define PLAYOUT_LANES 4
+
+static inline ull MCTSRandom(ull *state)
+{
+	ull x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+/*
+	a random square of the set, which must not be empty. its index is the high half of a
+	random number times the size of the set, which pdep turns into a square in the vector code
+*/
+static inline int RandomSquare(ull moves, ull *state)
+{
+	for (int k = (MCTSRandom(state) >> 32) * PopCount(moves) >> 32; k > 0; k--) moves &= moves - 1;
+	return __builtin_ctzll(moves);
+}
+
+/* plays random moves to the end of the game, returns the final disk difference for P */
+int RandomPlayout(ull P, ull O, ull *state)
+{
+	bool swapped = false;
+	for (;;) {
+		ull moves = GetMoves(P, O);
+		if (!moves) {
+			if (!GetMoves(O, P)) break;
+		} else {
+			int sq = RandomSquare(moves, state);
+			ull flips = GetFlips(sq, P, O);
+			P |= flips | BB_SQUARE(sq);
+			O &= ~flips;
+		}
+		ull t = P;
+		P = O;
+		O = t;
+		swapped = !swapped;
+	}
+	int diff = PopCount(P) - PopCount(O);
+	return swapped ? -diff : diff;
+}
+
+/* the random streams of the lanes of a batch, drawn from the caller's */
+static inline void PlayoutLaneStates(ull *state, ull *lanes)
+{
+	for (int i = 0; i < PLAYOUT_LANES; i++) lanes[i] = MCTSRandom(state);
+}
+
+/* shifts of the 8 directions: 4 to the left and 4 to the right, with the masks of bb_mask */
+#define PLAYOUT_SHIFTS { 1, 8, 9, 7 }
+#define PLAYOUT_LEFT_MASKS { ~BB_COL8, ~0ULL, ~BB_COL8, ~BB_COL1 }
+#define PLAYOUT_RIGHT_MASKS { ~BB_COL1, ~0ULL, ~BB_COL1, ~BB_COL8 }
+
+__attribute__((target("avx2")))
+static inline __m256i Shift4(__m256i b, int s, bool left)
+{
+	__m128i count = _mm_cvtsi32_si128(s);
+	return left ? _mm256_sll_epi64(b, count) : _mm256_srl_epi64(b, count);
+}
+
+/* GetMoves of every lane */
+__attribute__((target("avx2")))
+static inline __m256i GetMoves4(__m256i P, __m256i O)
+{
+	static const int shifts[4] = PLAYOUT_SHIFTS;
+	static const ull masks[2][4] = { PLAYOUT_LEFT_MASKS, PLAYOUT_RIGHT_MASKS };
+	__m256i empty = _mm256_xor_si256(_mm256_or_si256(P, O), _mm256_set1_epi64x(-1));
+	__m256i moves = _mm256_setzero_si256();
+	for (int side = 0; side < 2; side++) {
+		for (int d = 0; d < 4; d++) {
+			__m256i mask = _mm256_set1_epi64x(masks[side][d]);
+			__m256i Om = _mm256_and_si256(O, mask);
+			__m256i x = _mm256_and_si256(Shift4(P, shifts[d], side == 0), Om);
+			for (int i = 0; i < 5; i++) x = _mm256_or_si256(x, _mm256_and_si256(Shift4(x, shifts[d], side == 0), Om));
+			moves = _mm256_or_si256(moves, _mm256_and_si256(_mm256_and_si256(Shift4(x, shifts[d], side == 0), mask), empty));
+		}
+	}
+	return moves;
+}
+
+/* GetFlips of every lane for the move in M, a single bit or 0 for no move */
+__attribute__((target("avx2")))
+static inline __m256i GetFlips4(__m256i M, __m256i P, __m256i O)
+{
+	static const int shifts[4] = PLAYOUT_SHIFTS;
+	static const ull masks[2][4] = { PLAYOUT_LEFT_MASKS, PLAYOUT_RIGHT_MASKS };
+	__m256i zero = _mm256_setzero_si256();
+	__m256i flips = zero;
+	for (int side = 0; side < 2; side++) {
+		for (int d = 0; d < 4; d++) {
+			__m256i mask = _mm256_set1_epi64x(masks[side][d]);
+			__m256i Om = _mm256_and_si256(O, mask);
+			__m256i x = _mm256_and_si256(Shift4(M, shifts[d], side == 0), Om);
+			for (int i = 0; i < 5; i++) x = _mm256_or_si256(x, _mm256_and_si256(Shift4(x, shifts[d], side == 0), Om));
+			/* the run of opponent disks flips if a disk of the mover closes it */
+			__m256i closed = _mm256_and_si256(_mm256_and_si256(Shift4(x, shifts[d], side == 0), mask), P);
+			flips = _mm256_or_si256(flips, _mm256_andnot_si256(_mm256_cmpeq_epi64(closed, zero), x));
+		}
+	}
+	return flips;
+}
+
+__attribute__((target("avx2,bmi2")))
+void BatchPlayoutAVX2(const ull *P0, const ull *O0, ull *state, int *scores)
+{
+	__m256i P = _mm256_loadu_si256((const __m256i *) P0);
+	__m256i O = _mm256_loadu_si256((const __m256i *) O0);
+	ull done = 0, swapped = 0;
+	const ull all = (1 << PLAYOUT_LANES) - 1;
+	ull lanes[PLAYOUT_LANES];
+	PlayoutLaneStates(state, lanes);
+
+	while (done != all) {
+		ull moves[PLAYOUT_LANES], opponent[PLAYOUT_LANES], m[PLAYOUT_LANES], keep[PLAYOUT_LANES];
+		_mm256_storeu_si256((__m256i *) moves, GetMoves4(P, O));
+		bool stuck = false;
+		for (int i = 0; i < PLAYOUT_LANES; i++) stuck |= !moves[i] && !(done >> i & 1);
+		if (stuck) _mm256_storeu_si256((__m256i *) opponent, GetMoves4(O, P));
+
+		for (int i = 0; i < PLAYOUT_LANES; i++) {
+			m[i] = 0;
+			keep[i] = done >> i & 1 ? ~0ULL : 0;
+			if (keep[i]) continue;
+			if (moves[i]) {
+				/* the index of the move as RandomSquare picks it */
+				ull k = (MCTSRandom(&lanes[i]) >> 32) * PopCount(moves[i]) >> 32;
+				m[i] = _pdep_u64(1ULL << k, moves[i]);
+			} else if (!opponent[i]) {
+				done |= 1ULL << i;
+				keep[i] = ~0ULL;
+				continue;
+			}
+			/* a lane without a move passes: M is 0, nothing flips and the sides swap */
+			swapped ^= 1ULL << i;
+		}
+
+		__m256i M = _mm256_loadu_si256((const __m256i *) m);
+		__m256i K = _mm256_loadu_si256((const __m256i *) keep);
+		__m256i F = GetFlips4(M, P, O);
+		__m256i next_P = _mm256_andnot_si256(F, O);
+		__m256i next_O = _mm256_or_si256(_mm256_or_si256(P, F), M);
+		P = _mm256_blendv_epi8(next_P, P, K);
+		O = _mm256_blendv_epi8(next_O, O, K);
+	}
+
+	ull p[PLAYOUT_LANES], o[PLAYOUT_LANES];
+	_mm256_storeu_si256((__m256i *) p, P);
+	_mm256_storeu_si256((__m256i *) o, O);
+	for (int i = 0; i < PLAYOUT_LANES; i++) {
+		int diff = PopCount(p[i]) - PopCount(o[i]);
+		scores[i] = swapped >> i & 1 ? -diff : diff;
+	}
+}
+
+void BatchPlayoutScalar(const ull *P, const ull *O, ull *state, int *scores)
+{
+	ull lanes[PLAYOUT_LANES];
+	PlayoutLaneStates(state, lanes);
+	for (int i = 0; i < PLAYOUT_LANES; i++) scores[i] = RandomPlayout(P[i], O[i], &lanes[i]);
+}
+
+/* whether BatchPlayout runs the AVX2 code, decided once from the CPU */
+int playout_avx2 = -1;
+
+/* plays out the PLAYOUT_LANES positions (P[i], O[i]), the score of each for its P */
+void BatchPlayout(const ull *P, const ull *O, ull *state, int *scores)
+{
+	if (playout_avx2 < 0) playout_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+	if (playout_avx2) BatchPlayoutAVX2(P, O, state, scores);
+	else BatchPlayoutScalar(P, O, state, scores);
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+	Multi-ProbCut parameters.
+
+	The result v of a deep search to depth d is predicted from the result v' of a shallow
+	search to depth d' of the same node as v = a * v' + b, with a normally distributed error
+	of deviation sigma. The parameters depend on the game stage and on the depth pair; they
+	are fitted offline (othello probcut-fit) on random positions or on those of self-play
+	records, and read from a text file holding one depth pair per line:
+
+		stage depth shallow_depth a b sigma
+
+	Lines starting with '#' are comments. Several pairs may share a stage and a depth, they
+	are then tried in the order of the file.
+*/
+#ifndef PROBCUT_H
+#define PROBCUT_H
+
+#include <stdio.h>
+#include <math.h>
+#include "bitboard.h"
+
+#define MPC_STAGES 15
+#define MPC_MIN_DEPTH 5
+#define MPC_MAX_DEPTH 30
+#define MPC_MAX_PAIRS 4
+
+typedef struct { int shallow; double a, b, sigma; } ProbCutPair;
+
+ProbCutPair probcut_pairs[MPC_STAGES][MPC_MAX_DEPTH + 1][MPC_MAX_PAIRS];
+int nprobcut_pairs[MPC_STAGES][MPC_MAX_DEPTH + 1];
+
+/*
+	selectivity level of the search, 0 is an exact search. a cut at level l is taken when
+	the prediction clears the bound by probcut_t[l] deviations, so higher levels cut more
+	often and are wrong more often.
+*/
+#define MAX_SELECTIVITY 5
+int search_selectivity = 0;
+const double probcut_t[MAX_SELECTIVITY + 1] = { 0.0, 3.3, 2.6, 2.0, 1.5, 1.1 };
+
+/* stages group the positions by the number of disks on the board, 4 plies per stage */
+int ProbCutStage(ull disks)
+{
+	int stage = (PopCount(disks) - 4) / 4;
+	return stage < MPC_STAGES ? stage : MPC_STAGES - 1;
+}
+
+bool LoadProbCut(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		printf("cannot open probcut parameters %s\n", path);
+		return false;
+	}
+
+	char line[256];
+	int lineno = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n') continue;
+
+		int stage, depth;
+		ProbCutPair p;
+		if (sscanf(line, "%d %d %d %lf %lf %lf", &stage, &depth, &p.shallow, &p.a, &p.b, &p.sigma) != 6 ||
+		    stage < 0 || stage >= MPC_STAGES || depth < 1 || depth > MPC_MAX_DEPTH ||
+		    p.shallow < 0 || p.shallow >= depth || p.a <= 0 || p.sigma < 0) {
+			printf("%s:%d: bad probcut parameters\n", path, lineno);
+			fclose(f);
+			return false;
+		}
+		if (nprobcut_pairs[stage][depth] < MPC_MAX_PAIRS) {
+			probcut_pairs[stage][depth][nprobcut_pairs[stage][depth]++] = p;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+bool SaveProbCut(const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		printf("cannot write probcut parameters %s\n", path);
+		return false;
+	}
+	fprintf(f, "# stage depth shallow_depth a b sigma\n");
+	for (int stage = 0; stage < MPC_STAGES; stage++) {
+		for (int depth = MPC_MIN_DEPTH; depth <= MPC_MAX_DEPTH; depth++) {
+			for (int i = 0; i < nprobcut_pairs[stage][depth]; i++) {
+				const ProbCutPair *p = &probcut_pairs[stage][depth][i];
+				fprintf(f, "%d %d %d %.4f %.4f %.4f\n", stage, depth, p->shallow, p->a, p->b, p->sigma);
+			}
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/* running sums for the least squares fit of deep results (y) on shallow results (x) */
+typedef struct { double n, sx, sy, sxx, sxy, syy; } Regression;
+
+void RegressionAdd(Regression *r, double x, double y)
+{
+	r->n += 1;
+	r->sx += x;
+	r->sy += y;
+	r->sxx += x * x;
+	r->sxy += x * y;
+	r->syy += y * y;
+}
+
+/* fits y = a * x + b and returns the deviation of the residuals in sigma */
+bool RegressionFit(const Regression *r, ProbCutPair *p)
+{
+	double var_x = r->n * r->sxx - r->sx * r->sx;
+	if (r->n < 3 || var_x <= 0) return false;
+
+	p->a = (r->n * r->sxy - r->sx * r->sy) / var_x;
+	p->b = (r->sy - p->a * r->sx) / r->n;
+
+	/* sum of squared residuals expanded in terms of the running sums */
+	double sse = r->syy - 2 * p->a * r->sxy - 2 * p->b * r->sy + p->a * p->a * r->sxx
+		+ 2 * p->a * p->b * r->sx + p->b * p->b * r->n;
+	p->sigma = sqrt(sse > 0 ? sse / (r->n - 2) : 0);
+	return p->a > 0;
+}
+
+#endif
@@ -0,0 +1,290 @@
+/*
+	depth limited alpha-beta search used below the root by findBestMove.
+
+	Scores are from the point of view of the side to move (P). The remaining depth counts
+	plies; a pass does not use up depth, as in the original minimax, and a position where
+	neither side can move is scored by its final disk difference.
+	- near the root the search splits in young brothers wait fashion: the eldest move is
+	  searched first, then its brothers are searched in parallel with the bound it gave
+	- below SPLIT_DEPTH it is a serial fail-soft alpha-beta
+	- positions searched to at least TT_MIN_DEPTH go through the shared transposition
+	  table, whose bounds may decide a node outright and whose best move is searched first
+	- with --etc, nodes with at least ETC_MIN_DEPTH plies left first probe the table for
+	  each of their children (Enhanced Transposition Cutoff)
+	- with a selectivity above 0 both try Multi-ProbCut before searching the moves
+	- with the pattern and network evaluations the serial search carries their state (the
+	  pattern indexes or the first layer) down the tree, updating it move by move, so a
+	  leaf is not evaluated from the bitboards
+	- setting search_abort makes every running search return at once with a meaningless
+	  score, which its caller must throw away
+*/
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cilk/cilk.h>
+#include <math.h>
+#include <atomic>
+#include "bitboard.h"
+#include "counter.h"
+#include "endgame.h"
+#include "eval.h"
+#include "probcut.h"
+#include "tt.h"
+
+/* below this remaining depth the search no longer spawns */
+#define SPLIT_DEPTH 4
+
+/* below this remaining depth moves are searched in square order instead of fastest first */
+#define SORT_DEPTH 3
+
+/* below this remaining depth positions are neither probed in nor stored to the table */
+#define TT_MIN_DEPTH 2
+
+/* below this remaining depth the children are not probed for an Enhanced Transposition Cutoff */
+#define ETC_MIN_DEPTH 4
+
+bool search_etc = false;
+
+std::atomic<bool> search_abort(false);
+
+Counter search_nodes, probcut_probes, probcut_cutoffs, etc_probes, etc_cutoffs;
+
+/*
+	the evaluation at the search horizon, see eval.h. a finished game gets its exact score.
+	state is the EvalState of the position when the evaluation is incremental; without it
+	the state is built from the position.
+*/
+int Evaluate(ull P, ull O, const EvalState *state)
+{
+	if (eval_mode == EVAL_DISC || (P | O) == ~0ULL || (!GetMoves(P, O) && !GetMoves(O, P))) return PopCount(P) - PopCount(O);
+	if (eval_mode == EVAL_POSITIONAL) return EvaluatePositional(P, O);
+	if (state) return EvaluateState(state, P, O);
+	EvalState built;
+	EvalSetState(P, O, &built);
+	return EvaluateState(&built, P, O);
+}
+
+int AlphaBeta(ull P, ull O, int alpha, int beta, int depth, bool passed);
+
+/*
+	probes the table for the node. returns true along with the score in *score when the
+	stored bounds already decide it; in any case *move is the stored best move, or
+	TT_NO_MOVE when the node is not in the table.
+*/
+bool TTCutoff(ull P, ull O, int alpha, int beta, int depth, int *score, int *move)
+{
+	TTData d;
+	*move = TT_NO_MOVE;
+	if (!TTProbe(P, O, &d)) return false;
+
+	*move = d.move;
+	if (d.depth < depth) return false;
+	if (d.lower >= beta) *score = d.lower;
+	else if (d.upper <= alpha) *score = d.upper;
+	else if (d.lower == d.upper) *score = d.lower;
+	else return false;
+	return true;
+}
+
+/*
+	Enhanced Transposition Cutoff: if the table holds an upper bound for one of the children
+	that is already low enough, the move leading to it fails high and the node is cut
+	before any child is searched.
+*/
+bool ETCutoff(ull P, ull O, ull moves, int beta, int depth, int *score)
+{
+	if (!search_etc || !tt.entries || depth < ETC_MIN_DEPTH) return false;
+
+	for (; moves; moves &= moves - 1) {
+		int sq = __builtin_ctzll(moves);
+		ull flips = GetFlips(sq, P, O);
+		TTData d;
+		CounterAdd(&etc_probes, 1);
+		if (TTProbe(O & ~flips, P | flips | BB_SQUARE(sq), &d) && d.depth >= depth - 1 && -d.upper >= beta) {
+			CounterAdd(&etc_cutoffs, 1);
+			*score = -d.upper;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* puts the moves in search order: the table move first, then fastest first deep enough in the tree */
+int OrderMoves(ull P, ull O, ull moves, int depth, int hash_move, int *squares)
+{
+	int n = 0;
+	if (hash_move != TT_NO_MOVE && (moves & BB_SQUARE(hash_move))) {
+		squares[n++] = hash_move;
+		moves &= ~BB_SQUARE(hash_move);
+	}
+	if (depth >= SORT_DEPTH) return n + SortMoves(P, O, moves, squares + n);
+	for (; moves; moves &= moves - 1) squares[n++] = __builtin_ctzll(moves);
+	return n;
+}
+
+/*
+	Multi-ProbCut: shallow null window searches predict whether the deep search would fail
+	high or low. returns true along with the bound in *score when a cut is taken.
+*/
+bool ProbCut(ull P, ull O, int alpha, int beta, int depth, int *score)
+{
+	if (search_selectivity == 0 || depth < MPC_MIN_DEPTH || depth > MPC_MAX_DEPTH) return false;
+
+	int stage = ProbCutStage(P | O);
+	double t = probcut_t[search_selectivity];
+	for (int i = 0; i < nprobcut_pairs[stage][depth]; i++) {
+		const ProbCutPair *p = &probcut_pairs[stage][depth][i];
+		CounterAdd(&probcut_probes, 1);
+
+		int bound = (int) ceil((beta + t * p->sigma - p->b) / p->a);
+		if (bound <= 64 && AlphaBeta(P, O, bound - 1, bound, p->shallow, false) >= bound) {
+			CounterAdd(&probcut_cutoffs, 1);
+			*score = beta;
+			return true;
+		}
+
+		bound = (int) floor((alpha - t * p->sigma - p->b) / p->a);
+		if (bound >= -64 && AlphaBeta(P, O, bound, bound + 1, p->shallow, false) <= bound) {
+			CounterAdd(&probcut_cutoffs, 1);
+			*score = alpha;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* AlphaBeta with the EvalState of the position, NULL unless the evaluation is incremental */
+int AlphaBetaState(ull P, ull O, const EvalState *state, int alpha, int beta, int depth, bool passed)
+{
+	if (search_abort.load(std::memory_order_relaxed)) return 0;
+
+	CounterAdd(&search_nodes, 1);
+	if (depth == 0) return Evaluate(P, O, state);
+
+	EvalState child;
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return PopCount(P) - PopCount(O);
+		if (state) EvalPass(state, &child);
+		return -AlphaBetaState(O, P, state ? &child : NULL, -beta, -alpha, depth, true);
+	}
+
+	int score, hash_move = TT_NO_MOVE;
+	if (depth >= TT_MIN_DEPTH && TTCutoff(P, O, alpha, beta, depth, &score, &hash_move)) return score;
+	if (ETCutoff(P, O, moves, beta, depth, &score)) return score;
+	if (ProbCut(P, O, alpha, beta, depth, &score)) return score;
+
+	int squares[MAX_MOVES];
+	int n = OrderMoves(P, O, moves, depth, hash_move, squares);
+
+	int alpha0 = alpha, best = -SCORE_INF, best_sq = TT_NO_MOVE;
+	for (int i = 0; i < n; i++) {
+		int sq = squares[i];
+		ull flips = GetFlips(sq, P, O);
+		if (state) EvalMove(state, sq, flips, &child);
+		score = -AlphaBetaState(O & ~flips, P | flips | BB_SQUARE(sq), state ? &child : NULL, -beta, -alpha, depth - 1, false);
+		if (score > best) {
+			best = score;
+			best_sq = sq;
+			if (best > alpha) alpha = best;
+			if (alpha >= beta) break;
+		}
+	}
+
+	if (depth >= TT_MIN_DEPTH && !search_abort.load(std::memory_order_relaxed)) {
+		TTStore(P, O, depth, alpha0, beta, best, best_sq);
+	}
+	return best;
+}
+
+int AlphaBeta(ull P, ull O, int alpha, int beta, int depth, bool passed)
+{
+	if (!EvalIncremental()) return AlphaBetaState(P, O, NULL, alpha, beta, depth, passed);
+	EvalState state;
+	EvalSetState(P, O, &state);
+	return AlphaBetaState(P, O, &state, alpha, beta, depth, passed);
+}
+
+/*
+	parallel search of the upper plies, see SolveEndgameParallel for the splitting scheme.
+	the brothers publish their scores in a shared alpha, so the ones that start later search
+	with the best bound found so far and are skipped once it reaches beta.
+*/
+int SearchParallel(ull P, ull O, int alpha, int beta, int depth, bool passed)
+{
+	if (depth < SPLIT_DEPTH) return AlphaBeta(P, O, alpha, beta, depth, passed);
+	if (search_abort.load(std::memory_order_relaxed)) return 0;
+
+	CounterAdd(&search_nodes, 1);
+
+	ull moves = GetMoves(P, O);
+	if (!moves) {
+		if (passed) return PopCount(P) - PopCount(O);
+		return -SearchParallel(O, P, -beta, -alpha, depth, true);
+	}
+
+	int best, hash_move;
+	if (TTCutoff(P, O, alpha, beta, depth, &best, &hash_move)) return best;
+	if (ETCutoff(P, O, moves, beta, depth, &best)) return best;
+	if (ProbCut(P, O, alpha, beta, depth, &best)) return best;
+
+	int squares[MAX_MOVES], scores[MAX_MOVES];
+	int n = OrderMoves(P, O, moves, depth, hash_move, squares);
+
+	int alpha0 = alpha, best_sq = squares[0];
+	ull flips = GetFlips(squares[0], P, O);
+	best = -SearchParallel(O & ~flips, P | flips | BB_SQUARE(squares[0]), -beta, -alpha, depth - 1, false);
+	if (best > alpha) alpha = best;
+
+	if (alpha < beta && n > 1) {
+		std::atomic<int> shared_alpha(alpha);
+		cilk_for(int i = 1; i < n; i++) {
+			int a = shared_alpha.load(std::memory_order_relaxed);
+			if (a >= beta) {
+				scores[i] = -SCORE_INF;
+				continue;
+			}
+			ull f = GetFlips(squares[i], P, O);
+			scores[i] = -SearchParallel(O & ~f, P | f | BB_SQUARE(squares[i]), -beta, -a, depth - 1, false);
+			RaiseBound(&shared_alpha, scores[i]);
+		}
+		for (int i = 1; i < n; i++) {
+			if (scores[i] > best) {
+				best = scores[i];
+				best_sq = squares[i];
+			}
+		}
+	}
+
+	if (!search_abort.load(std::memory_order_relaxed)) TTStore(P, O, depth, alpha0, beta, best, best_sq);
+	return best;
+}
+
+/*
+	serial search of the root moves for the strategies that run whole searches side by side
+	instead of splitting the tree. the best square goes to *best_sq, ties are broken towards
+	the highest square as MoveComparison does.
+*/
+int SearchRoot(ull P, ull O, int depth, int *best_sq)
+{
+	TTData d;
+	int squares[MAX_MOVES];
+	int n = OrderMoves(P, O, GetMoves(P, O), depth, TTProbe(P, O, &d) ? d.move : TT_NO_MOVE, squares);
+
+	int best = -SCORE_INF;
+	*best_sq = TT_NO_MOVE;
+	for (int i = 0; i < n; i++) {
+		ull flips = GetFlips(squares[i], P, O);
+		/* a window starting just below best keeps the scores of equally good moves exact */
+		int score = -AlphaBeta(O & ~flips, P | flips | BB_SQUARE(squares[i]), -SCORE_INF, -(best - 1), depth - 1, false);
+		if (search_abort.load(std::memory_order_relaxed)) return best;
+		if (score > best || (score == best && squares[i] > *best_sq)) {
+			best = score;
+			*best_sq = squares[i];
+		}
+	}
+	TTStore(P, O, depth, -SCORE_INF, SCORE_INF, best, *best_sq);
+	return best;
+}
+
+#endif
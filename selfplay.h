@@ -0,0 +1,242 @@
+/*
+	self-play generation of training positions (othello selfplay), for fitting the weights
+	of the evaluations and the ProbCut parameters offline (pattern-train, probcut-fit).
+
+	Every game starts from a random opening, a number of random plies from the start board
+	seeded by the game, and is then played by the search to a fixed depth, both sides the
+	same. Each position searched becomes a record labeled with its score: the search score
+	at that depth, or the exact score once the position has at most exact_empties empty
+	squares, when the game is solved to the end instead. The final disk difference of the
+	game is added to every record at the end of it.
+
+	The games run in batches of SELFPLAY_BATCH_GAMES per worker, one whole game per
+	iteration of a cilk_for, each searched serially through the shared transposition
+	table, as the book builder does with its leaves. After a batch its records are appended
+	to the file and flushed and the throughput is printed, so the memory held is that of
+	one batch however many games are played. The file is
+
+		char magic[8] = "OTHREC01";
+		SelfPlayRecord records[];
+
+	in the byte order of the machine. A run appends to an existing file, dropping a record
+	cut short by a kill, and seeds its openings from the size of the file so that it does
+	not replay the games already in it.
+*/
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "bitboard.h"
+#include "counter.h"
+#include "endgame.h"
+#include "playout.h"
+#include "search.h"
+#include "tt.h"
+
+#define SELFPLAY_MAGIC "OTHREC01"
+
+/* games per worker in a batch, the records are written once per batch */
+#define SELFPLAY_BATCH_GAMES 4
+
+/* depth of an exact label */
+#define SELFPLAY_EXACT_DEPTH 60
+
+/*
+	a position with the side to move P, its label score, the final disk difference of the
+	game result, both for P, and the depth of the label. 24 bytes.
+*/
+typedef struct { ull P, O; signed char score, result; unsigned char depth; unsigned char pad[5]; } SelfPlayRecord;
+
+Counter selfplay_positions;
+
+/* the position after plies random moves from (P, O), false when the game ends before */
+bool SelfPlayOpening(ull seed, int plies, ull *P, ull *O)
+{
+	ull state = seed * 0x9e3779b97f4a7c15ULL | 1;
+	for (int ply = 0; ply < plies; ply++) {
+		ull moves = GetMoves(*P, *O);
+		if (!moves) {
+			if (!GetMoves(*O, *P)) return false;
+			std::swap(*P, *O);
+			continue;
+		}
+		int sq = RandomSquare(moves, &state);
+		ull flips = GetFlips(sq, *P, *O);
+		ull mover = *P | flips | BB_SQUARE(sq);
+		*P = *O & ~flips;
+		*O = mover;
+	}
+	return true;
+}
+
+/* the exact score of the position, which has a move, and a best square of it, serially */
+int SelfPlaySolve(ull P, ull O, int *best_sq)
+{
+	int squares[MAX_MOVES];
+	int n = SortMoves(P, O, GetMoves(P, O), squares);
+	int best = -SCORE_INF;
+	for (int i = 0; i < n; i++) {
+		ull flips = GetFlips(squares[i], P, O);
+		int score = -SolveEndgame(O & ~flips, P | flips | BB_SQUARE(squares[i]), -SCORE_INF, -best, false);
+		if (score > best) {
+			best = score;
+			*best_sq = squares[i];
+		}
+	}
+	return best;
+}
+
+/* plays the game of the seed from the start board and puts the records of its positions in records */
+void SelfPlayGame(ull start_P, ull start_O, ull seed, int depth, int exact_empties, int random_plies,
+	std::vector<SelfPlayRecord> *records)
+{
+	ull P = start_P, O = start_O;
+	while (!SelfPlayOpening(seed, random_plies, &P, &O)) {
+		P = start_P;
+		O = start_O;
+		seed += 1ULL << 32;
+	}
+
+	/* side is 0 when the side to move of the opening is to move, for the results */
+	std::vector<int> sides;
+	int side = 0;
+	records->clear();
+	for (;;) {
+		ull moves = GetMoves(P, O);
+		if (!moves) {
+			if (!GetMoves(O, P)) break;
+			std::swap(P, O);
+			side ^= 1;
+			continue;
+		}
+		SelfPlayRecord r;
+		memset(&r, 0, sizeof(r));
+		r.P = P;
+		r.O = O;
+		int score = 0, best_sq = TT_NO_MOVE;
+		if (64 - PopCount(P | O) <= exact_empties) {
+			score = SelfPlaySolve(P, O, &best_sq);
+			r.depth = SELFPLAY_EXACT_DEPTH;
+		} else {
+			for (int d = 1; d <= depth; d++) score = SearchRoot(P, O, d, &best_sq);
+			r.depth = depth;
+		}
+		r.score = score;
+		records->push_back(r);
+		sides.push_back(side);
+
+		ull flips = GetFlips(best_sq, P, O);
+		ull mover = P | flips | BB_SQUARE(best_sq);
+		P = O & ~flips;
+		O = mover;
+		side ^= 1;
+	}
+	int result = PopCount(P) - PopCount(O);
+	if (side) result = -result;
+	for (size_t i = 0; i < records->size(); i++) (*records)[i].result = sides[i] ? -result : result;
+	CounterAdd(&selfplay_positions, records->size());
+}
+
+/*
+	plays ngames games from the start board (P, O) into the records file at path, see the
+	top. returns 0 once they are written and 1 on errors.
+*/
+int SelfPlay(ull P, ull O, int ngames, int depth, int exact_empties, int random_plies, const char *path)
+{
+	/* a new file gets its magic, an old one loses a record cut short */
+	FILE *f = fopen(path, "rb");
+	long size = 0;
+	if (f) {
+		char magic[8];
+		bool ok = fread(magic, 8, 1, f) == 1 && memcmp(magic, SELFPLAY_MAGIC, 8) == 0;
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		fclose(f);
+		if (!ok) {
+			printf("%s is not a file of training records\n", path);
+			return 1;
+		}
+		size = 8 + (size - 8) / sizeof(SelfPlayRecord) * sizeof(SelfPlayRecord);
+		if (truncate(path, size) != 0) {
+			printf("cannot truncate %s\n", path);
+			return 1;
+		}
+	}
+	f = fopen(path, "ab");
+	if (!f || (size == 0 && fwrite(SELFPLAY_MAGIC, 8, 1, f) != 1)) {
+		printf("cannot write %s\n", path);
+		if (f) fclose(f);
+		return 1;
+	}
+
+	ull seed = size;
+	int batch = SELFPLAY_BATCH_GAMES * __cilkrts_get_nworkers();
+	std::vector<std::vector<SelfPlayRecord> > games(batch);
+	CounterReset(&selfplay_positions);
+	TTNewSearch();
+	timer_start();
+	for (int start = 0; start < ngames; start += batch) {
+		int n = std::min(batch, ngames - start);
+		cilk_for(int i = 0; i < n; i++) {
+			SelfPlayGame(P, O, seed + start + i, depth, exact_empties, random_plies, &games[i]);
+		}
+		for (int i = 0; i < n; i++) {
+			if (fwrite(games[i].data(), sizeof(SelfPlayRecord), games[i].size(), f) != games[i].size()) {
+				printf("cannot write %s\n", path);
+				fclose(f);
+				return 1;
+			}
+		}
+		fflush(f);
+		double elapsed = timer_elapsed();
+		ull positions = CounterTotal(&selfplay_positions);
+		printf("selfplay games=%d/%d positions=%llu time=%.1f games_per_second=%.2f positions_per_second=%.0f\n",
+			start + n, ngames, positions, elapsed, (start + n) / elapsed, positions / elapsed);
+		fflush(stdout);
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+	reads n records spread evenly over the records file at path, in the order of the file.
+	false when it is not a file of records or holds fewer than n.
+*/
+bool SelfPlaySample(const char *path, int n, std::vector<SelfPlayRecord> *records)
+{
+	FILE *f = fopen(path, "rb");
+	char magic[8];
+	if (!f || fread(magic, 8, 1, f) != 1 || memcmp(magic, SELFPLAY_MAGIC, 8) != 0) {
+		printf("%s is not a file of training records\n", path);
+		if (f) fclose(f);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	long total = (ftell(f) - 8) / sizeof(SelfPlayRecord);
+	if (total < n) {
+		printf("%s holds %ld records, fewer than %d\n", path, total, n);
+		fclose(f);
+		return false;
+	}
+	records->resize(n);
+	for (int i = 0; i < n; i++) {
+		long k = (long) ((double) i * total / n);
+		bool ok = fseek(f, 8 + k * sizeof(SelfPlayRecord), SEEK_SET) == 0
+			&& fread(&(*records)[i], sizeof(SelfPlayRecord), 1, f) == 1;
+		if (!ok) {
+			printf("cannot read %s\n", path);
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+	stable disk estimation.
+
+	A disk is stable when no sequence of moves can ever flip it. The estimate below is
+	conservative (every disk it reports is really stable, but it may miss some):
+	- disks on the four edges come from a table holding the exact stable disks of every
+	  (player, opponent) configuration of an 8 square edge
+	- an inner disk is stable when, along each of the 4 line directions, the line through it
+	  is full or one of its two neighbors on that line is already a stable disk of the same
+	  color. this is repeated until no more disks become stable.
+*/
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#include "bitboard.h"
+
+/* edge_stability[P][O]: disks of P on an edge holding P and O that can never be flipped */
+unsigned char edge_stability[256][256];
+
+/* expands an 8 bit edge into column 8 of a bitboard (bit i of the edge is row 8-i) */
+ull edge_to_col8[256];
+
+/* the lines of each direction: 8 rows, 8 columns and 15 diagonals each way */
+ull line_masks[4][15];
+int nline_masks[4];
+
+#define INNER_SQUARES 0x007e7e7e7e7e7e00ULL
+
+/* packs column 8 of a bitboard into 8 bits (bit i of the edge is bit 8*i of the board) */
+#define COL8_TO_EDGE(b) ((int) ((((b) & BB_COL8) * 0x0102040810204080ULL) >> 56))
+
+/* the disks of O flipped on an edge when P plays on x */
+int EdgeFlips(int P, int O, int x)
+{
+	int flips = 0, line = 0, y;
+
+	for (y = x - 1; y >= 0 && (O >> y & 1); y--) line |= 1 << y;
+	if (y >= 0 && (P >> y & 1)) flips |= line;
+
+	line = 0;
+	for (y = x + 1; y < 8 && (O >> y & 1); y++) line |= 1 << y;
+	if (y < 8 && (P >> y & 1)) flips |= line;
+
+	return flips;
+}
+
+/*
+	narrows the candidate set stable down to the disks of P that survive every
+	sequence of moves on the edge, by both players, from this configuration.
+	a move on the edge is tried even when it flips nothing on the edge itself since it
+	may be legal through another direction.
+*/
+int FindEdgeStable(int P, int O, int stable)
+{
+	int empty = ~(P | O) & 0xff;
+
+	stable &= P;
+	if (!stable || !empty) return stable;
+
+	for (int x = 0; x < 8; x++) {
+		if (!(empty >> x & 1)) continue;
+
+		int flips = EdgeFlips(P, O, x);
+		stable = FindEdgeStable(P | flips | (1 << x), O & ~flips, stable);
+		if (!stable) return 0;
+
+		flips = EdgeFlips(O, P, x);
+		stable = FindEdgeStable(P & ~flips, O | flips | (1 << x), stable);
+		if (!stable) return 0;
+	}
+	return stable;
+}
+
+void InitStability()
+{
+	for (int P = 0; P < 256; P++) {
+		for (int O = 0; O < 256; O++) {
+			edge_stability[P][O] = (P & O) ? 0 : FindEdgeStable(P, O, P);
+		}
+	}
+
+	for (int e = 0; e < 256; e++) {
+		edge_to_col8[e] = 0;
+		for (int i = 0; i < 8; i++) {
+			if (e >> i & 1) edge_to_col8[e] |= BB_SQUARE(8 * i);
+		}
+	}
+
+	for (int i = 0; i < 4; i++) nline_masks[i] = 0;
+	for (int i = 0; i < 8; i++) {
+		line_masks[0][nline_masks[0]++] = 0xffULL << (8 * i);
+		line_masks[1][nline_masks[1]++] = BB_COL8 << i;
+	}
+	/* diagonals are walked from their starting square on row 8 or on column 8 / column 1 */
+	for (int start = 0; start < 15; start++) {
+		ull d9 = 0, d7 = 0;
+		int row = start < 8 ? 0 : start - 7, col = start < 8 ? start : 0;
+		for (int r = row, c = col; r < 8 && c < 8; r++, c++) d9 |= BB_SQUARE(8 * r + c);
+		col = start < 8 ? 7 - start : 7;
+		for (int r = row, c = col; r < 8 && c >= 0; r++, c--) d7 |= BB_SQUARE(8 * r + c);
+		line_masks[2][nline_masks[2]++] = d9;
+		line_masks[3][nline_masks[3]++] = d7;
+	}
+}
+
+/* the stable disks of P lying on the 4 edges */
+ull EdgeStableDisks(ull P, ull O)
+{
+	ull stable = 0;
+
+	stable |= (ull) edge_stability[P & 0xff][O & 0xff];
+	stable |= (ull) edge_stability[P >> 56][O >> 56] << 56;
+	stable |= edge_to_col8[edge_stability[COL8_TO_EDGE(P)][COL8_TO_EDGE(O)]];
+	stable |= edge_to_col8[edge_stability[COL8_TO_EDGE(P >> 7)][COL8_TO_EDGE(O >> 7)]] << 7;
+
+	return stable;
+}
+
+/* full[i]: the squares whose line in direction i (row, column, both diagonals) has no empty */
+void FullLines(ull disks, ull full[4])
+{
+	for (int i = 0; i < 4; i++) {
+		full[i] = 0;
+		for (int j = 0; j < nline_masks[i]; j++) {
+			ull line = line_masks[i][j];
+			if ((disks & line) == line) full[i] |= line;
+		}
+	}
+}
+
+ull StableDisks(ull P, ull O)
+{
+	ull full[4];
+	ull inner = P & INNER_SQUARES;
+	ull stable = EdgeStableDisks(P, O);
+
+	FullLines(P | O, full);
+	stable |= inner & full[0] & full[1] & full[2] & full[3];
+	if (!stable) return 0;
+
+	ull previous;
+	do {
+		previous = stable;
+		ull h = full[0] | (stable >> 1) | (stable << 1);
+		ull v = full[1] | (stable >> 8) | (stable << 8);
+		ull d9 = full[2] | (stable >> 9) | (stable << 9);
+		ull d7 = full[3] | (stable >> 7) | (stable << 7);
+		stable |= inner & h & v & d9 & d7;
+	} while (stable != previous);
+
+	return stable;
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+	offline fitting of the pattern weights (othello pattern-train) to the records of selfplay.
+
+	The pattern evaluation is linear in its weights: the score of a position is the sum of
+	the weight of each pattern's configuration plus the bias of its stage. Fitting the
+	weights to the labeled positions is then a sparse least squares problem, one per stage
+	since a position only uses the tables of its stage, solved by stochastic gradient
+	descent on the squared error in disks between the evaluation and the label (the search
+	or exact score of the record):
+	- the records are streamed from the file TRAIN_CHUNK_RECORDS at a time, shuffled within
+	  the chunk and cut into mini-batches of TRAIN_BATCH, so the data can be far larger
+	  than the memory; every epoch reads the file again
+	- for a mini-batch, the workers compute the pattern indexes and the error of each
+	  position in parallel; the gradient is then applied stage by stage in parallel, the
+	  stages having no weight in common. each weight moves by the learning rate times its
+	  mean error over the positions of the batch using it, so the bias and the frequent
+	  configurations do not take steps as large as the batch
+	- every TRAIN_VALIDATION-th record of the file is held out and only measured, the error
+	  on them printed after each epoch next to the training error
+	The weights are fitted in floating point and written at the end, rounded to
+	1/PATTERN_SCALE disks, as the binary file PatternOpen maps.
+*/
+#ifndef TRAIN_H
+#define TRAIN_H
+
+#include <cilk/cilk.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "bitboard.h"
+#include "pattern.h"
+#include "selfplay.h"
+
+/* records read from the file at a time */
+#define TRAIN_CHUNK_RECORDS (1 << 20)
+
+/* positions per gradient step */
+#define TRAIN_BATCH 4096
+
+/* one record in this many is held out for validation */
+#define TRAIN_VALIDATION 16
+
+/* the features of a position: its weights in the tables of all stages, the bias last */
+typedef struct { int weights[PATTERN_INSTANCES + 1]; int stage; float error; } TrainSample;
+
+/* the weights of the position's features, and its error in disks with the weights w */
+void TrainFeatures(const SelfPlayRecord *r, const float *w, TrainSample *s)
+{
+	PatternIndexes x;
+	PatternSetIndexes(r->P, r->O, &x);
+	s->stage = PatternStage(r->P, r->O);
+	int base = s->stage * PATTERN_WEIGHTS;
+	float sum = 0;
+	for (int i = 0; i < PATTERN_INSTANCES; i++) {
+		s->weights[i] = base + pattern_base[i] + x.index[0][i];
+		sum += w[s->weights[i]];
+	}
+	s->weights[PATTERN_INSTANCES] = base + PATTERN_WEIGHTS - 1;
+	sum += w[s->weights[PATTERN_INSTANCES]];
+	s->error = sum - r->score;
+}
+
+/* writes the weights to path through a temporary file, so a reader never maps half of it */
+bool TrainWrite(const char *path, const std::vector<float> &w)
+{
+	std::string tmp = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (!f) {
+		printf("cannot write %s\n", tmp.c_str());
+		return false;
+	}
+	PatternHeader header;
+	memcpy(header.magic, PATTERN_MAGIC, 8);
+	header.nstages = PATTERN_STAGES;
+	header.nweights = PATTERN_WEIGHTS;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (size_t i = 0; ok && i < w.size(); i++) {
+		double v = w[i] * PATTERN_SCALE;
+		short q = v > 32767 ? 32767 : v < -32767 ? -32767 : (short) lround(v);
+		ok = fwrite(&q, sizeof(q), 1, f) == 1;
+	}
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), path) != 0) {
+		printf("cannot write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+/*
+	fits the pattern weights to the records file for epochs passes with the learning rate
+	and writes them to path. returns 0 once they are written and 1 on errors.
+*/
+int PatternTrain(const char *records, const char *path, int epochs, double rate)
+{
+	std::vector<float> w((size_t) PATTERN_STAGES * PATTERN_WEIGHTS, 0.0f);
+	std::vector<float> gradient(w.size(), 0.0f);
+	std::vector<int> count(w.size(), 0);
+	std::vector<SelfPlayRecord> chunk(TRAIN_CHUNK_RECORDS);
+	std::vector<TrainSample> samples(TRAIN_BATCH);
+	std::vector<int> order;
+	unsigned int seed = 1;
+
+	timer_start();
+	for (int epoch = 1; epoch <= epochs; epoch++) {
+		FILE *f = fopen(records, "rb");
+		char magic[8];
+		if (!f || fread(magic, 8, 1, f) != 1 || memcmp(magic, SELFPLAY_MAGIC, 8) != 0) {
+			printf("%s is not a file of training records\n", records);
+			if (f) fclose(f);
+			return 1;
+		}
+
+		ull index = 0, ntrain = 0, nvalid = 0;
+		double train_error = 0, valid_error = 0;
+		size_t n;
+		while ((n = fread(chunk.data(), sizeof(SelfPlayRecord), TRAIN_CHUNK_RECORDS, f)) > 0) {
+			/* the held out records are the same in every epoch, whatever the shuffle */
+			std::vector<int> valid;
+			order.clear();
+			for (size_t i = 0; i < n; i++, index++) {
+				if (index % TRAIN_VALIDATION == 0) valid.push_back(i);
+				else order.push_back(i);
+			}
+			for (size_t i = order.size(); i > 1; i--) std::swap(order[i - 1], order[rand_r(&seed) % i]);
+
+			for (size_t start = 0; start < valid.size(); start += TRAIN_BATCH) {
+				int m = std::min(valid.size() - start, (size_t) TRAIN_BATCH);
+				cilk_for(int i = 0; i < m; i++) TrainFeatures(&chunk[valid[start + i]], w.data(), &samples[i]);
+				for (int i = 0; i < m; i++) valid_error += samples[i].error * samples[i].error;
+				nvalid += m;
+			}
+
+			for (size_t start = 0; start < order.size(); start += TRAIN_BATCH) {
+				int m = std::min(order.size() - start, (size_t) TRAIN_BATCH);
+				cilk_for(int i = 0; i < m; i++) TrainFeatures(&chunk[order[start + i]], w.data(), &samples[i]);
+				for (int i = 0; i < m; i++) train_error += samples[i].error * samples[i].error;
+				ntrain += m;
+
+				cilk_for(int stage = 0; stage < PATTERN_STAGES; stage++) {
+					for (int i = 0; i < m; i++) {
+						const TrainSample *s = &samples[i];
+						if (s->stage != stage) continue;
+						for (int k = 0; k <= PATTERN_INSTANCES; k++) {
+							gradient[s->weights[k]] += s->error;
+							count[s->weights[k]]++;
+						}
+					}
+					for (int i = 0; i < m; i++) {
+						const TrainSample *s = &samples[i];
+						if (s->stage != stage) continue;
+						for (int k = 0; k <= PATTERN_INSTANCES; k++) {
+							int j = s->weights[k];
+							if (!count[j]) continue;
+							w[j] -= rate * gradient[j] / count[j];
+							gradient[j] = 0;
+							count[j] = 0;
+						}
+					}
+				}
+			}
+		}
+		fclose(f);
+		double elapsed = timer_elapsed();
+		printf("pattern-train epoch=%d records=%llu train_rmse=%.3f valid_rmse=%.3f time=%.1f records_per_second=%.0f\n",
+			epoch, index, ntrain ? sqrt(train_error / ntrain) : 0.0, nvalid ? sqrt(valid_error / nvalid) : 0.0, elapsed,
+			index * epoch / elapsed);
+		fflush(stdout);
+	}
+	return TrainWrite(path, w) ? 0 : 1;
+}
+
+#endif
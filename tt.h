@@ -0,0 +1,255 @@
+/*
+	transposition table shared by all workers.
+
+	An entry holds a lower and an upper bound on the score of a position searched to some
+	remaining depth, along with the best move found there. Entries are written without locks
+	as two words: the key word holds the position hash xored with the data word, so a probe
+	that reads the key of one store and the data of another fails the check instead of
+	returning bounds of a different position. Entries come in buckets of TT_BUCKET; a store
+	goes to the entry of the same position or else replaces the shallowest one.
+	Every entry is stamped with the date of the search that stored it. The table is kept
+	from one search of a game to the next, since the computer's next search is two plies
+	deeper into the same tree; a new date only ages it: entries of older dates are still
+	returned, but a store replaces the oldest entry of the bucket before a shallow fresh one.
+
+	A search that has to be deterministic can defer its stores: while tt_defer is set each
+	worker appends them to its own log instead of writing the table, and TTFlush writes all
+	of them in one order that does not depend on the timing of the workers. The log is cut
+	into the serial tasks of the search (TTDeferTask), and a task that stores more than
+	TT_DEFER_MAX entries only keeps the deepest of them, chosen from its own stores alone so
+	that what is dropped does not depend on the timing either.
+
+	Next to the entries the table keeps the positions that some worker is currently
+	searching, for ABDADA. A busy slot holds the hash of its position, or 0 when free; a
+	position whose slot is taken by another one is just not marked, which only costs ABDADA
+	a chance to defer it.
+*/
+#ifndef TT_H
+#define TT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cilk/cilk_api.h>
+#include "bitboard.h"
+
+#define TT_BUCKET 4
+#define TT_NO_MOVE 64
+
+/* an entry one date older counts as this many plies shallower when choosing what to replace */
+#define TT_AGE_PLIES 64
+
+/* bounds, depth and move of a position as packed in the data word of an entry */
+typedef struct { int lower; int upper; int depth; int move; } TTData;
+
+typedef struct { std::atomic<ull> key; std::atomic<ull> data; } TTEntry;
+
+#define TT_BUSY_SLOTS (1 << 16)
+
+typedef struct { TTEntry *entries; ull mask; int date; std::atomic<ull> busy[TT_BUSY_SLOTS]; } TranspositionTable;
+
+TranspositionTable tt;
+
+/* size of the table in MB */
+int tt_megabytes = 64;
+
+#define TT_LOGS 256
+
+typedef struct { ull hash; ull data; } TTLogEntry;
+
+/* deferred stores kept per task, beyond them the shallowest half is dropped */
+#define TT_DEFER_MAX (1 << 16)
+
+bool tt_defer = false;
+std::vector<TTLogEntry> tt_logs[TT_LOGS];
+size_t tt_log_task[TT_LOGS];
+
+ull HashPosition(ull P, ull O)
+{
+	ull h = P * 0x9e3779b97f4a7c15ULL ^ (O + 0x632be59bd9b4e019ULL) * 0xc2b2ae3d27d4eb4fULL;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+void TTClear()
+{
+	if (!tt.entries) return;
+	for (ull i = 0; i <= tt.mask; i++) {
+		tt.entries[i].key.store(0, std::memory_order_relaxed);
+		tt.entries[i].data.store(0, std::memory_order_relaxed);
+	}
+}
+
+/* rounds the size down to a power of two number of entries. a size of 0 disables the table */
+bool TTInit(int megabytes)
+{
+	free(tt.entries);
+	tt.entries = NULL;
+	tt.mask = 0;
+	tt.date = 1;
+	if (megabytes <= 0) return true;
+
+	ull n = TT_BUCKET;
+	while (2 * n * sizeof(TTEntry) <= (ull) megabytes << 20) n *= 2;
+
+	tt.entries = (TTEntry *) calloc(n, sizeof(TTEntry));
+	if (!tt.entries) {
+		printf("cannot allocate a %d MB transposition table\n", megabytes);
+		return false;
+	}
+	tt.mask = n - 1;
+	/* touch every page now rather than during the first search */
+	TTClear();
+	return true;
+}
+
+/* starts a new date, aging the entries stored so far. dates wrap after 255 searches, emptying the table */
+void TTNewSearch()
+{
+	if (++tt.date == 256) {
+		TTClear();
+		tt.date = 1;
+	}
+}
+
+#define TT_DATE(data) ((int) ((data) >> 32 & 0xff))
+
+static inline ull TTPack(const TTData *d)
+{
+	return (ull) (d->lower + 128) | (ull) (d->upper + 128) << 8 | (ull) d->depth << 16 | (ull) d->move << 24
+		| (ull) tt.date << 32;
+}
+
+static inline void TTUnpack(ull data, TTData *d)
+{
+	d->lower = (int) (data & 0xff) - 128;
+	d->upper = (int) (data >> 8 & 0xff) - 128;
+	d->depth = (int) (data >> 16 & 0xff);
+	d->move = (int) (data >> 24 & 0xff);
+}
+
+bool TTProbe(ull P, ull O, TTData *d)
+{
+	if (!tt.entries) return false;
+
+	ull h = HashPosition(P, O);
+	TTEntry *bucket = &tt.entries[h & tt.mask & ~(ull) (TT_BUCKET - 1)];
+	for (int i = 0; i < TT_BUCKET; i++) {
+		ull data = bucket[i].data.load(std::memory_order_relaxed);
+		ull key = bucket[i].key.load(std::memory_order_relaxed);
+		if ((key ^ data) == h && TT_DATE(data) != 0) {
+			TTUnpack(data, d);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* writes the data word of position h over the entry of its bucket that is least worth keeping */
+void TTWrite(ull h, ull data)
+{
+	TTEntry *bucket = &tt.entries[h & tt.mask & ~(ull) (TT_BUCKET - 1)];
+	TTEntry *replace = &bucket[0];
+	int replace_depth = 1 << 30;
+	for (int i = 0; i < TT_BUCKET; i++) {
+		ull entry_data = bucket[i].data.load(std::memory_order_relaxed);
+		ull key = bucket[i].key.load(std::memory_order_relaxed);
+		if ((key ^ entry_data) == h) {
+			replace = &bucket[i];
+			break;
+		}
+		/* empty entries have date 0, the oldest there is */
+		int age = (tt.date - TT_DATE(entry_data)) & 0xff;
+		int entry_depth = (int) (entry_data >> 16 & 0xff) - age * TT_AGE_PLIES;
+		if (entry_depth < replace_depth) {
+			replace = &bucket[i];
+			replace_depth = entry_depth;
+		}
+	}
+
+	replace->key.store(h ^ data, std::memory_order_relaxed);
+	replace->data.store(data, std::memory_order_relaxed);
+}
+
+/*
+	stores the result of a fail-soft search of the position to depth with the window
+	(alpha, beta): a score at or below alpha is an upper bound, one at or above beta a
+	lower bound, anything in between is exact.
+*/
+void TTStore(ull P, ull O, int depth, int alpha, int beta, int score, int move)
+{
+	if (!tt.entries) return;
+
+	TTData d;
+	d.lower = score > alpha ? score : -SCORE_INF;
+	d.upper = score < beta ? score : SCORE_INF;
+	d.depth = depth;
+	d.move = move;
+
+	ull h = HashPosition(P, O);
+	if (tt_defer) {
+		int w = __cilkrts_get_worker_number() & (TT_LOGS - 1);
+		std::vector<TTLogEntry> &log = tt_logs[w];
+		if (log.size() - tt_log_task[w] == TT_DEFER_MAX) {
+			std::sort(log.begin() + tt_log_task[w], log.end(), [](const TTLogEntry &a, const TTLogEntry &b) {
+				int depth_a = a.data >> 16 & 0xff, depth_b = b.data >> 16 & 0xff;
+				if (depth_a != depth_b) return depth_a > depth_b;
+				return a.hash != b.hash ? a.hash < b.hash : a.data < b.data;
+			});
+			log.resize(tt_log_task[w] + TT_DEFER_MAX / 2);
+		}
+		TTLogEntry e = { h, TTPack(&d) };
+		log.push_back(e);
+		return;
+	}
+	TTWrite(h, TTPack(&d));
+}
+
+/*
+	starts a task of deferred stores on the calling worker: a serial search whose stores
+	are always the same, from one run to the next, and are capped together
+*/
+void TTDeferTask()
+{
+	int w = __cilkrts_get_worker_number() & (TT_LOGS - 1);
+	tt_log_task[w] = tt_logs[w].size();
+}
+
+/* writes the deferred stores of all the workers, ordered by hash and then data */
+void TTFlush()
+{
+	std::vector<TTLogEntry> all;
+	for (int i = 0; i < TT_LOGS; i++) {
+		all.insert(all.end(), tt_logs[i].begin(), tt_logs[i].end());
+		tt_logs[i].clear();
+		tt_log_task[i] = 0;
+	}
+	std::sort(all.begin(), all.end(), [](const TTLogEntry &a, const TTLogEntry &b) {
+		return a.hash != b.hash ? a.hash < b.hash : a.data < b.data;
+	});
+	for (size_t i = 0; i < all.size(); i++) TTWrite(all[i].hash, all[i].data);
+}
+
+/* marks the position as being searched, returns false when its busy slot is taken */
+bool TTMarkBusy(ull h)
+{
+	ull free_slot = 0;
+	return tt.busy[h & (TT_BUSY_SLOTS - 1)].compare_exchange_strong(free_slot, h, std::memory_order_relaxed);
+}
+
+void TTUnmarkBusy(ull h)
+{
+	ull marked = h;
+	tt.busy[h & (TT_BUSY_SLOTS - 1)].compare_exchange_strong(marked, 0, std::memory_order_relaxed);
+}
+
+bool TTIsBusy(ull h)
+{
+	return tt.busy[h & (TT_BUSY_SLOTS - 1)].load(std::memory_order_relaxed) == h;
+}
+
+#endif